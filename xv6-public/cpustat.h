@@ -0,0 +1,11 @@
+// Per-cpu scheduler statistics, see getcpustat().
+struct cpustat {
+  uint nsteal;    // processes stolen from busier cpus
+  uint nmigrate;  // dispatches of a process that last ran elsewhere
+  int nqueued;    // mlfq processes on this cpu's run queue
+  uint nidle;     // times the cpu halted with nothing to run
+  uint idleticks; // ticks spent halted
+  uint nhandoff;  // direct switches from one thread to a sibling
+  uint ngang;     // threads run to join their gang
+  uint ninherit;  // priorities lent to sleeplock holders
+};
@@ -1,14 +1,21 @@
 struct buf;
 struct context;
+struct cpu;
+struct cpustat;
 struct file;
 struct inode;
+struct mlfqparam;
+struct mm;
 struct pipe;
 struct proc;
 struct rtcdate;
+struct schedev;
+struct sched_class;
 struct spinlock;
 struct sleeplock;
 struct stat;
 struct superblock;
+struct timer;
 
 // bio.c
 void            binit(void);
@@ -22,6 +29,9 @@ void            cprintf(char*, ...);
 void            consoleintr(int(*)(void));
 void            panic(char*) __attribute__((noreturn));
 
+// edf.c
+int             edf_admit(struct proc*, int, int);
+
 // exec.c
 int             exec(char*, char**);
 
@@ -55,6 +65,12 @@ int             readi(struct inode*, char*, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, char*, uint, uint);
 
+// futex.c
+void            futexinit(void);
+int             futex_wait(uint, int);
+int             futex_wake(uint, int);
+void            futexdrop(struct proc*);
+
 // ide.c
 void            ideinit(void);
 void            ideintr(void);
@@ -81,6 +97,8 @@ extern volatile uint*    lapic;
 void            lapiceoi(void);
 void            lapicinit(void);
 void            lapicstartap(uchar, uint);
+void            lapictimer(int);
+void            lapicipi(int, int);
 void            microdelay(int);
 
 // log.c
@@ -89,6 +107,18 @@ void            log_write(struct buf*);
 void            begin_op();
 void            end_op();
 
+// mlfq.c
+void            mlfq_getparam(struct mlfqparam*);
+int             mlfq_setparam(struct mlfqparam*);
+
+// mm.c
+void            mminit(void);
+struct mm*      mmalloc(pde_t*);
+struct mm*      mmdup(struct mm*);
+void            mmput(struct mm*);
+void            mmlock(struct mm*);
+void            mmunlock(struct mm*);
+
 // mp.c
 extern int      ismp;
 void            mpinit(void);
@@ -122,14 +152,39 @@ void            userinit(void);
 int             wait(void);
 void            wakeup(void*);
 void            yield(void);
-void            mlfq_yield(void);
-void            stride_yield(void);
+void            schedtick(void);
+void            schedclock(void);
+void            resched(struct cpu*);
+int             needresched(void);
+void            kick(struct cpu*);
+void            deallocthread(struct proc*, int);
+void            kickidle(struct proc*);
+void            setclass(struct proc*, struct sched_class*);
 int             getlev(void);
 int             set_cpu_share(int tickets);
 int             thread_create(thread_t *thread, void *(*start_routine)(void *), void *arg);
 int             thread_join(thread_t thread, void **retval);
 void            thread_exit(void *retval);
+int             thread_join_any(thread_t *thread, void **retval);
+int             thread_detach(thread_t thread);
 void            printallstate(void);
+int             getcpustat(int, struct cpustat*);
+void            inheritprio(struct proc*);
+void            restoreprio(void);
+int             set_mlfq_floor(int);
+int             yield_to(thread_t);
+int             set_gang(int);
+int             sched_setaffinity(int, uint);
+int             sched_getaffinity(int, uint*);
+int             set_deadline(int, int);
+int             getmlfqparam(struct mlfqparam*);
+int             setmlfqparam(struct mlfqparam*);
+
+// stride.c
+void            strideinit(void);
+int             stride_reserve(int, int);
+int             stride_setlimit(int);
+void            stride_settickets(struct proc*, int);
 
 // swtch.S
 void            swtch(struct context**, struct context*);
@@ -145,6 +200,7 @@ void            popcli(void);
 
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
+void            acquiresleepspin(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
 int             holdingsleep(struct sleeplock*);
 void            initsleeplock(struct sleeplock*, char*);
@@ -167,7 +223,14 @@ int             fetchstr(uint, char**);
 void            syscall(void);
 
 // timer.c
-void            timerinit(void);
+void            timeradd(struct timer*, uint, void (*)(void*), void*);
+int             timerdel(struct timer*);
+void            timertick(void);
+
+// trace.c
+void            traceinit(void);
+void            trace(int, struct proc*, int);
+int             schedtrace(int, struct schedev*, int);
 
 // trap.c
 void            idtinit(void);
@@ -0,0 +1,269 @@
+// Earliest-deadline-first scheduling class.
+//
+// An edf process reserves runtime ticks of cpu in every period
+// ticks. It has an absolute deadline and a budget of ticks it may
+// run before that deadline; the RUNNABLE ones are kept in a list
+// ordered by deadline and the earliest runs first. The class has
+// precedence over stride and mlfq, and a process becoming ready
+// preempts a cpu running something with a later deadline.
+//
+// A process that uses up its budget is throttled until its
+// deadline, when the next period starts with a fresh budget.
+// A waking process whose budget cannot be spent by its deadline
+// at its reserved rate also starts a new period (the constant
+// bandwidth server rule), so sleeping cannot bank cpu time.
+//
+// Reservations are tickets out of the same limited capacity
+// that stride processes reserve from (stride_reserve).
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "sched.h"
+
+#define EDF_READY      1
+#define EDF_THROTTLED  2
+
+// Is tick a before tick b?
+#define before(a, b) ((int)((a) - (b)) < 0)
+
+static struct {
+  struct proc *ready;          // RUNNABLE processes by deadline
+  struct proc *throttled;      // out of budget, by deadline
+} edf;
+
+// Insert p into the list at *head, keeping it ordered by deadline.
+static void
+insert(struct proc **head, struct proc *p, int onq)
+{
+  struct proc *q, *prev = 0;
+
+  for (q = *head; q; prev = q, q = q->edf.next)
+    if (before(p->edf.deadline, q->edf.deadline))
+      break;
+  p->edf.prev = prev;
+  p->edf.next = q;
+  if (prev)
+    prev->edf.next = p;
+  else
+    *head = p;
+  if (q)
+    q->edf.prev = p;
+  p->edf.onq = onq;
+}
+
+static void
+unlink(struct proc **head, struct proc *p)
+{
+  if (p->edf.prev)
+    p->edf.prev->edf.next = p->edf.next;
+  else
+    *head = p->edf.next;
+  if (p->edf.next)
+    p->edf.next->edf.prev = p->edf.prev;
+  p->edf.next = 0;
+  p->edf.prev = 0;
+  p->edf.onq = 0;
+}
+
+// Start a new period for p now.
+static void
+replenish(struct proc *p)
+{
+  p->edf.deadline = ticks + p->edf.period;
+  p->edf.budget = p->edf.runtime;
+}
+
+// p is ready with deadline p->edf.deadline. Preempt the cpu
+// running the process that should give way to it: one outside
+// the class if any, else the edf process with the latest deadline
+// after p's. Nothing is preempted while some cpu is idle or about
+// to schedule anyway.
+static void
+preempt(struct proc *p)
+{
+  struct cpu *c, *victim = 0;
+  struct proc *q;
+
+  for (c = cpus; c < &cpus[ncpu]; c++) {
+    if (!cpuallowed(p, c))
+      continue;
+    if (c->idle || (q = c->proc) == 0 || q->state != RUNNING)
+      return;
+    if (q->sclass != &edf_class) {
+      victim = c;
+      break;
+    }
+    if (before(p->edf.deadline, q->edf.deadline)
+        && (victim == 0
+            || before(victim->proc->edf.deadline, q->edf.deadline)))
+      victim = c;
+  }
+  if (victim)
+    resched(victim);
+}
+
+static void
+edf_init(struct proc *p)
+{
+  replenish(p);
+  p->edf.throttled = 0;
+  p->edf.next = 0;
+  p->edf.prev = 0;
+  p->edf.onq = 0;
+}
+
+static void
+edf_enqueue(struct proc *p, int flags)
+{
+  if (p->edf.onq)
+    panic("edf_enqueue");
+  if (p->edf.throttled) {
+    insert(&edf.throttled, p, EDF_THROTTLED);
+    return;
+  }
+  if ((flags & ENQ_WAKEUP)
+      && (!before(ticks, p->edf.deadline)
+          || (uint64)p->edf.budget * p->edf.period
+             > (uint64)(p->edf.deadline - ticks) * p->edf.runtime))
+    replenish(p);
+  insert(&edf.ready, p, EDF_READY);
+  preempt(p);
+}
+
+static void
+edf_dequeue(struct proc *p)
+{
+  if (p->edf.onq == EDF_READY)
+    unlink(&edf.ready, p);
+  else if (p->edf.onq == EDF_THROTTLED)
+    unlink(&edf.throttled, p);
+}
+
+// Run the ready process with the earliest deadline that may run
+// on c. One that missed its deadline while queued starts a new
+// period.
+static struct proc*
+edf_pick(struct cpu *c)
+{
+  struct proc *p;
+
+  for (p = edf.ready; p; p = p->edf.next)
+    if (cpuallowed(p, c))
+      break;
+  if (p == 0)
+    return 0;
+  edf_dequeue(p);
+  if (!before(ticks, p->edf.deadline))
+    replenish(p);
+  return p;
+}
+
+// Charge the tick to the budget; throttle p once it is used up.
+// It goes onto the throttled list when yield() re-queues it.
+static int
+edf_tick(struct proc *p)
+{
+  if (--p->edf.budget > 0)
+    return 0;
+  p->edf.throttled = 1;
+  return 1;
+}
+
+static void
+edf_yield(struct proc *p)
+{
+}
+
+static int
+edf_nrunnable(struct cpu *c)
+{
+  struct proc *p;
+  int n = 0;
+
+  for (p = edf.ready; p; p = p->edf.next)
+    if (cpuallowed(p, c))
+      n++;
+  return n;
+}
+
+// Give back the capacity p reserved.
+static void
+edf_leave(struct proc *p)
+{
+  edf_dequeue(p);
+  stride_reserve(p->edf.tickets, 0);
+  p->edf.tickets = 0;
+  p->edf.throttled = 0;
+}
+
+// Is the head of the throttled list due for a new period?
+// Runs without ptable.lock, so it only peeks.
+static int
+edf_clockdue(void)
+{
+  struct proc *p = edf.throttled;
+
+  return p && !before(ticks, p->edf.deadline);
+}
+
+// Start the next period of every throttled process whose
+// deadline has come, and make it ready again.
+static void
+edf_clock(void)
+{
+  struct proc *p;
+
+  while ((p = edf.throttled) != 0 && !before(ticks, p->edf.deadline)) {
+    unlink(&edf.throttled, p);
+    p->edf.throttled = 0;
+    p->edf.deadline += p->edf.period;
+    p->edf.budget = p->edf.runtime;
+    if (!before(ticks, p->edf.deadline))
+      replenish(p);
+    edf_enqueue(p, 0);
+    kickidle(p);
+  }
+}
+
+// Admit p into the class to run runtime ticks every period ticks,
+// or change its reservation if it is in the class already.
+// Returns -1 if the parameters are bad or the capacity is not
+// there. Caller holds ptable.lock.
+int
+edf_admit(struct proc *p, int runtime, int period)
+{
+  int old = 0, tickets;
+
+  if (runtime <= 0 || period < runtime || period > 100000)
+    return -1;
+  tickets = (runtime * MAXTICKETS + period - 1) / period;
+  if (p->sclass == &edf_class)
+    old = p->edf.tickets;
+  if (stride_reserve(old, tickets) < 0)
+    return -1;
+
+  p->edf.runtime = runtime;
+  p->edf.period = period;
+  p->edf.tickets = tickets;
+  setclass(p, &edf_class);
+  return 0;
+}
+
+struct sched_class edf_class = {
+  .name = "edf",
+  .init = edf_init,
+  .enqueue = edf_enqueue,
+  .dequeue = edf_dequeue,
+  .pick_next = edf_pick,
+  .tick = edf_tick,
+  .yield = edf_yield,
+  .nrunnable = edf_nrunnable,
+  .leave = edf_leave,
+  .clockdue = edf_clockdue,
+  .clock = edf_clock,
+};
@@ -3,6 +3,9 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "mm.h"
 #include "defs.h"
 #include "x86.h"
 #include "elf.h"
@@ -17,6 +20,7 @@ exec(char *path, char **argv)
   struct inode *ip;
   struct proghdr ph;
   pde_t *pgdir, *oldpgdir;
+  struct mm *mm;
   struct proc *curproc = myproc();
 
   begin_op();
@@ -96,11 +100,14 @@ exec(char *path, char **argv)
   safestrcpy(curproc->name, last, sizeof(curproc->name));
   deallocthread(curproc, curproc->pid);
   // Commit to the user image.
-  oldpgdir = curproc->pgdir;
+  mm = curproc->mm;
+  oldpgdir = mm->pgdir;
+  mm->pgdir = pgdir;
+  mm->heap = heap;
+  mm->stack = stack;
+  mm->maxtid = 0;
+  mm->sz = sz;
   curproc->pgdir = pgdir;
-  curproc->sz = sz; 
-  curproc->heap = heap; 
-  curproc->stack = stack;
   curproc->tf->eip = elf.entry;  // main
   curproc->tf->esp = sp;
   switchuvm(curproc);
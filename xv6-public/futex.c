@@ -0,0 +1,143 @@
+// Futexes: blocking on a word of user memory.
+//
+// futex_wait(addr, val) puts the caller to sleep if the word at addr
+// still holds val; futex_wake(addr, n) wakes up to n processes asleep
+// on addr. A lock built on them enters the kernel only when it has
+// to wait or has a waiter to wake.
+//
+// Waiters hang in a hash table keyed by address space (pgdir) and user
+// virtual address, so the threads of one process meet on the same
+// word. futex_wait checks the word and goes to sleep under the bucket
+// lock and futex_wake takes waiters off under it, so a wake that
+// follows a store to the word cannot be missed.
+// Bucket locks come before ptable.lock.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "mm.h"
+
+#define NFUTEX 64
+
+struct futexq {
+  struct spinlock lock;
+  struct proc *head;      // waiters, oldest first
+};
+
+static struct futexq futexq[NFUTEX];
+
+void
+futexinit(void)
+{
+  int i;
+
+  for(i = 0; i < NFUTEX; i++)
+    initlock(&futexq[i].lock, "futex");
+}
+
+static struct futexq*
+bucket(pde_t *pgdir, uint addr)
+{
+  return &futexq[((uint)pgdir ^ (addr >> 2) ^ (addr >> 8)) % NFUTEX];
+}
+
+// Take p off q if it is still there. Caller holds q->lock.
+static void
+unlink(struct futexq *q, struct proc *p)
+{
+  struct proc **pp;
+
+  for(pp = &q->head; *pp; pp = &(*pp)->fnext)
+    if(*pp == p){
+      *pp = p->fnext;
+      break;
+    }
+  p->fnext = 0;
+  p->faddr = 0;
+}
+
+// Sleep on the user word at addr as long as it holds val.
+// Returns 0 when woken by futex_wake, -1 if the word did not hold
+// val, addr is not a mapped, aligned user word, or we were killed.
+int
+futex_wait(uint addr, int val)
+{
+  struct proc *p = myproc();
+  struct futexq *q;
+  struct proc **pp;
+  char *page;
+
+  if(addr % sizeof(int) || addr >= p->mm->sz)
+    return -1;
+  if((page = uva2ka(p->pgdir, (char*)addr)) == 0)
+    return -1;
+  q = bucket(p->pgdir, addr);
+  acquire(&q->lock);
+  if(*(int*)(page + (addr & (PGSIZE-1))) != val){
+    release(&q->lock);
+    return -1;
+  }
+  p->fpgdir = p->pgdir;
+  p->faddr = addr;
+  p->fnext = 0;
+  for(pp = &q->head; *pp; pp = &(*pp)->fnext)
+    ;
+  *pp = p;
+  while(p->faddr && !p->killed)
+    sleep(&p->faddr, &q->lock);
+  if(p->faddr){
+    unlink(q, p);
+    release(&q->lock);
+    return -1;
+  }
+  release(&q->lock);
+  return 0;
+}
+
+// Wake up to n processes waiting on the user word at addr,
+// oldest first. Returns how many were woken.
+int
+futex_wake(uint addr, int n)
+{
+  struct proc *p = myproc();
+  struct futexq *q;
+  struct proc **pp, *w;
+  int woken = 0;
+
+  q = bucket(p->pgdir, addr);
+  acquire(&q->lock);
+  for(pp = &q->head; (w = *pp) != 0 && woken < n; ){
+    if(w->fpgdir != p->pgdir || w->faddr != addr){
+      pp = &w->fnext;
+      continue;
+    }
+    *pp = w->fnext;
+    w->fnext = 0;
+    w->faddr = 0;
+    wakeup(&w->faddr);
+    woken++;
+  }
+  release(&q->lock);
+  return woken;
+}
+
+// Forget that p waits on a futex; p is being torn down.
+void
+futexdrop(struct proc *p)
+{
+  struct futexq *q;
+
+  if(p->faddr == 0)
+    return;
+  q = bucket(p->fpgdir, p->faddr);
+  acquire(&q->lock);
+  if(p->faddr)
+    unlink(q, p);
+  release(&q->lock);
+}
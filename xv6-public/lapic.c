@@ -113,6 +113,33 @@ lapiceoi(void)
     lapicw(EOI, 0);
 }
 
+// Stop or restart the periodic timer of this cpu.
+void
+lapictimer(int on)
+{
+  if(!lapic)
+    return;
+  if(on){
+    lapicw(TIMER, PERIODIC | (T_IRQ0 + IRQ_TIMER));
+    lapicw(TICR, 10000000);
+  } else {
+    lapicw(TIMER, MASKED | PERIODIC | (T_IRQ0 + IRQ_TIMER));
+  }
+}
+
+// Send a fixed interrupt with the given vector to the cpu
+// with the given APIC ID. Interrupts must be disabled.
+void
+lapicipi(int apicid, int vector)
+{
+  if(!lapic)
+    return;
+  lapicw(ICRHI, apicid<<24);
+  lapicw(ICRLO, FIXED | ASSERT | vector);
+  while(lapic[ICRLO] & DELIVS)
+    ;
+}
+
 // Spin for a given number of microseconds.
 // On real hardware would want to tune this dynamically.
 void
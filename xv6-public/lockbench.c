@@ -0,0 +1,89 @@
+/**
+ *  Process table lock benchmark. For k = 1 up to the number of cpus
+ * (at most 8), k workers, each pinned to a cpu of its own, fork,
+ * exit and wait as fast as they can for RUN ticks. Meanwhile a
+ * prober on the last cpu counts how often it gets through yield(),
+ * which takes the scheduler lock every time.
+ *  With the process tree under its own lock, the fork rate should
+ * grow with k and the prober should not slow down much.
+ *
+ *  usage: lockbench [ticks]
+ *  Output lines are a record name followed by key=value fields.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+int run = 100;                      // (ticks)
+
+// Loop fork/exit/wait on cpu until the deadline, report the count.
+void
+forker(int cpu, uint end, int fd)
+{
+  uint n = 0;
+  int pid;
+
+  sched_setaffinity(0, 1 << cpu);
+  while (uptime() < end) {
+    if ((pid = fork()) == 0)
+      exit();
+    if (pid < 0)
+      continue;
+    wait();
+    n++;
+  }
+  write(fd, &n, sizeof(n));
+  exit();
+}
+
+void
+prober(int cpu, uint end, int fd)
+{
+  uint n = 0;
+
+  sched_setaffinity(0, 1 << cpu);
+  while (uptime() < end) {
+    yield();
+    n++;
+  }
+  write(fd, &n, sizeof(n));
+  exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+  int ncpu, k, i, fd[2], probe[2];
+  uint end, n, forks, yields;
+
+  if (argc > 1)
+    run = atoi(argv[1]);
+  ncpu = ncpus();
+
+  for (k = 1; k <= ncpu; k++) {
+    pipe(fd);
+    pipe(probe);
+    end = uptime() + run;
+    for (i = 0; i < k; i++)
+      if (fork() == 0)
+        forker(i, end, fd[1]);
+    if (fork() == 0)
+      prober(ncpu - 1, end, probe[1]);
+    for (i = 0; i <= k; i++)
+      wait();
+    forks = 0;
+    for (i = 0; i < k; i++) {
+      read(fd[0], &n, sizeof(n));
+      forks += n;
+    }
+    read(probe[0], &yields, sizeof(yields));
+    close(fd[0]);
+    close(fd[1]);
+    close(probe[0]);
+    close(probe[1]);
+    printf(1, "lockbench cpus=%d ticks=%d forks=%d forks_per_tick=%d "
+              "yields=%d\n", k, run, forks, forks / run, yields);
+  }
+  exit();
+}
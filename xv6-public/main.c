@@ -27,6 +27,9 @@ main(void)
   consoleinit();   // console hardware
   uartinit();      // serial port
   pinit();         // process table
+  mminit();        // address spaces
+  traceinit();     // scheduler trace
+  futexinit();     // futex wait queues
   tvinit();        // trap vectors
   binit();         // buffer cache
   fileinit();      // file table
@@ -0,0 +1,448 @@
+// Multi-level feedback queue scheduling class.
+//
+// RUNNABLE mlfq processes are kept in per-cpu run queues with one
+// FIFO per level (struct runq). A bitmap of non-empty levels gives
+// the highest level to run in O(1). A process is queued on the cpu
+// it last ran on; a cpu with nothing queued steals from the busiest
+// peer.
+//
+// A process that waits too long at a low level moves up by aging:
+// once a tick each cpu looks at the head of each of its levels,
+// which has waited longest there, and moves it up one level if it
+// has waited param.aging ticks. With aging off, every process goes
+// back to level 0 at once every param.boost ticks instead.
+//
+// A process holding a sleeplock that a process at a higher level
+// (or in another class) waits for runs at the waiter's level (or
+// level 0) until it releases its last sleeplock; see inheritprio().
+//
+// Every thread of a process is a separate struct proc. In group-fair
+// mode the ticks run by each thread group are added up in its main
+// thread, and a cpu runs the queued thread whose group has run
+// least at the highest level, so that a group gets the same share of
+// a level however many threads it has. Threads of one group keep
+// their FIFO order. Fairness is per cpu.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "sched.h"
+#include "mlfqparam.h"
+#include "schedtrace.h"
+
+#define DEBUG 0
+
+// A process that left its cpu less than MIGRATECOST ticks ago
+// is assumed to be cache-hot there and is not stolen lightly.
+#define MIGRATECOST 2
+
+static struct {
+  int tick;                    // mlfq tick for boost
+  int boostgen;                // bumped by every boost
+  uint gclock;                 // gservice of the group picked last
+  struct mlfqparam param;      // see setmlfqparam()
+} mlfq = {
+  .param = {
+    .nlevel = 3,
+    .quantum = { 1, 2, 4 },
+    .allotment = { 5, 10 },
+    .boost = 100,
+    .aging = 50,
+  },
+};
+
+// Is a before b, in ticks of group service?
+#define before(a, b) ((int)((a) - (b)) < 0)
+
+// The level p runs at: its own, or a higher one lent to it. A
+// process left at a level that was removed by setmlfqparam() runs
+// at the lowest one.
+static int
+level(struct proc *p)
+{
+  if (p->mlfq.priority >= mlfq.param.nlevel)
+    p->mlfq.priority = mlfq.param.nlevel - 1;
+  if (p->mlfq.ilevel < p->mlfq.priority)
+    return p->mlfq.ilevel;
+  return p->mlfq.priority;
+}
+
+static int
+ticklimit(struct proc *p)
+{
+  return mlfq.param.quantum[level(p)];
+}
+
+// Append p to the tail of level lev of rq.
+static void
+rqappend(struct runq *rq, struct proc *p, int lev)
+{
+  p->mlfq.next = 0;
+  p->mlfq.prev = rq->tail[lev];
+  if (rq->tail[lev])
+    rq->tail[lev]->mlfq.next = p;
+  else
+    rq->head[lev] = p;
+  rq->tail[lev] = p;
+  rq->bitmap |= 1 << lev;
+  rq->nproc++;
+  p->mlfq.enqtick = ticks;
+}
+
+// Unlink p from level lev of rq.
+static void
+rqunlink(struct runq *rq, struct proc *p, int lev)
+{
+  if (p->mlfq.prev)
+    p->mlfq.prev->mlfq.next = p->mlfq.next;
+  else
+    rq->head[lev] = p->mlfq.next;
+  if (p->mlfq.next)
+    p->mlfq.next->mlfq.prev = p->mlfq.prev;
+  else
+    rq->tail[lev] = p->mlfq.prev;
+  if (rq->head[lev] == 0)
+    rq->bitmap &= ~(1 << lev);
+  p->mlfq.next = 0;
+  p->mlfq.prev = 0;
+  rq->nproc--;
+}
+
+static void
+mlfq_init(struct proc *p)
+{
+  p->mlfq.priority = 0;
+  p->mlfq.tick = 0;
+  p->mlfq.runticks = 0;
+  p->mlfq.next = 0;
+  p->mlfq.prev = 0;
+  p->mlfq.rqcpu = 0;
+  p->mlfq.gservice = mlfq.gclock;
+  p->mlfq.ilevel = NLEVEL;
+}
+
+// Queue p at the tail of its level, on the cpu it last ran on,
+// or on this or else its first allowed cpu. A cpu other than
+// this one may be halted with its timer off, so it is kicked.
+static void
+mlfq_enqueue(struct proc *p, int flags)
+{
+  struct cpu *c;
+
+  if (p->mlfq.rqcpu)
+    panic("mlfq_enqueue");
+  if ((c = p->cpu) == 0 || !cpuallowed(p, c))
+    c = mycpu();
+  if (!cpuallowed(p, c))
+    c = &cpus[bsf(p->affinity)];
+  p->mlfq.boostgen = mlfq.boostgen;
+  // A group that has not run for a while does not get to
+  // make up for it all at once.
+  if (before(p->main_thread->mlfq.gservice, mlfq.gclock))
+    p->main_thread->mlfq.gservice = mlfq.gclock;
+  rqappend(&c->rq, p, level(p));
+  p->mlfq.rqcpu = c;
+  kick(c);
+}
+
+// Take p off the run queue holding it, if any.
+// A process queued before the last boost has been spliced
+// onto level 0, so its mlfq state is reset here.
+static void
+mlfq_dequeue(struct proc *p)
+{
+  if (p->mlfq.rqcpu == 0)
+    return;
+  if (p->mlfq.boostgen != mlfq.boostgen) {
+    p->mlfq.priority = 0;
+    p->mlfq.tick = 0;
+    p->mlfq.runticks = 0;
+  }
+  rqunlink(&p->mlfq.rqcpu->rq, p, level(p));
+  p->mlfq.rqcpu = 0;
+}
+
+// Dequeue the head of the highest non-empty level of rq, or in
+// group-fair mode the first thread there of the group that has
+// run least.
+static struct proc*
+rqpop(struct runq *rq)
+{
+  struct proc *p, *q;
+
+  if (rq->bitmap == 0)
+    return 0;
+  p = rq->head[bsf(rq->bitmap)];
+  if (mlfq.param.groupfair) {
+    for (q = p->mlfq.next; q; q = q->mlfq.next)
+      if (before(q->main_thread->mlfq.gservice,
+                 p->main_thread->mlfq.gservice))
+        p = q;
+    mlfq.gclock = p->main_thread->mlfq.gservice;
+  }
+  mlfq_dequeue(p);
+  return p;
+}
+
+// Move every queued mlfq process to level 0 by splicing the
+// lower levels onto the level 0 queue of each cpu. Their per-level
+// counters are reset lazily by mlfq_dequeue.
+static void
+boost(void)
+{
+#if DEBUG
+  cprintf("[do boosting]\n");
+#endif
+  struct cpu *c;
+  struct runq *rq;
+  int lev;
+
+  mlfq.tick = 0;
+  mlfq.boostgen++;
+  trace(SEV_BOOST, 0, 0);
+
+  for (c = cpus; c < &cpus[ncpu]; c++) {
+    rq = &c->rq;
+    for (lev = 1; lev < NLEVEL; lev++) {
+      if (rq->head[lev] == 0)
+        continue;
+      if (rq->tail[0]) {
+        rq->tail[0]->mlfq.next = rq->head[lev];
+        rq->head[lev]->mlfq.prev = rq->tail[0];
+      } else {
+        rq->head[0] = rq->head[lev];
+      }
+      rq->tail[0] = rq->tail[lev];
+      rq->head[lev] = 0;
+      rq->tail[lev] = 0;
+    }
+    rq->bitmap = rq->head[0] ? 1 : 0;
+  }
+}
+
+// Move the head of each level of rq up one level if it has waited
+// there param.aging ticks. At most one process per level moves.
+static void
+age(struct runq *rq)
+{
+  struct proc *p;
+  int lev;
+
+  rq->agetick = ticks;
+  for (lev = 1; lev < mlfq.param.nlevel; lev++) {
+    p = rq->head[lev];
+    if (p == 0 || ticks - p->mlfq.enqtick < mlfq.param.aging)
+      continue;
+    rqunlink(rq, p, lev);
+    p->mlfq.priority = lev - 1;
+    p->mlfq.tick = 0;
+    p->mlfq.runticks = 0;
+    rqappend(rq, p, lev - 1);
+    trace(SEV_PRIO, p, lev - 1);
+  }
+}
+
+static void
+check_down_priority(struct proc* p)
+{
+  if (p->mlfq.priority >= mlfq.param.nlevel - 1) return ;
+  if (p->mlfq.runticks >= mlfq.param.allotment[p->mlfq.priority]) {
+#if DEBUG
+    cprintf("PRIORITY DOWN\n");
+#endif
+    p->mlfq.priority++;
+    p->mlfq.tick = 0;
+    p->mlfq.runticks = 0;
+    trace(SEV_PRIO, p, p->mlfq.priority);
+  }
+}
+
+// Steal an mlfq process for the idle cpu c from the busiest peer.
+// Only the highest level queued there is considered, and only the
+// processes there that may run on c. A cache-cold process is
+// preferred; a cache-hot one is taken only when the peer has more
+// queued work than it can run next.
+static struct proc*
+mlfq_steal(struct cpu *c)
+{
+  struct cpu *oc, *busiest;
+  struct proc *p, *hot;
+
+  busiest = 0;
+  for (oc = cpus; oc < &cpus[ncpu]; oc++) {
+    if (oc == c || oc->rq.nproc == 0)
+      continue;
+    if (busiest == 0 || oc->rq.nproc > busiest->rq.nproc)
+      busiest = oc;
+  }
+  if (busiest == 0)
+    return 0;
+
+  hot = 0;
+  for (p = busiest->rq.head[bsf(busiest->rq.bitmap)]; p; p = p->mlfq.next) {
+    if (!cpuallowed(p, c))
+      continue;
+    if (ticks - p->lastrun >= MIGRATECOST)
+      break;
+    if (hot == 0)
+      hot = p;
+  }
+  if (p == 0) {
+    if (hot == 0 || busiest->rq.nproc < 2)
+      return 0;
+    p = hot;
+  }
+
+  mlfq_dequeue(p);
+  c->nsteal++;
+  return p;
+}
+
+// Charge p the tick it starts running with.
+static void
+mlfq_charge(struct proc *p)
+{
+  mlfq.tick++;
+  p->mlfq.tick++;
+  p->mlfq.runticks++;
+  p->main_thread->mlfq.gservice++;
+#if DEBUG
+  cprintf("schd call %d\n", p->mlfq.priority);
+#endif
+  check_down_priority(p);
+}
+
+// Pick the head of the highest non-empty level of c's run
+// queue, or stolen work, and charge it.
+static struct proc*
+mlfq_pick(struct cpu *c)
+{
+  struct proc *p;
+
+  if (mlfq.param.aging) {
+    if (c->rq.agetick != ticks)
+      age(&c->rq);
+  } else if (mlfq.param.boost && mlfq.tick >= mlfq.param.boost) {
+    boost();
+  }
+
+  if ((p = rqpop(&c->rq)) == 0 && (p = mlfq_steal(c)) == 0)
+    return 0;
+  mlfq_charge(p);
+  return p;
+}
+
+// Keep running until the time slice of the level is used up.
+static int
+mlfq_tick(struct proc *p)
+{
+  if (p->mlfq.tick < ticklimit(p)) {
+    p->mlfq.tick++;
+    p->mlfq.runticks++;
+    __sync_fetch_and_add(&mlfq.tick, 1);
+    __sync_fetch_and_add(&p->main_thread->mlfq.gservice, 1);
+#if DEBUG
+    cprintf("mlfq call %d\n", p->mlfq.priority);
+#endif
+    check_down_priority(p);
+    return 0;
+  }
+  return 1;
+}
+
+static void
+mlfq_yield(struct proc *p)
+{
+  p->mlfq.tick = 0;
+}
+
+static int
+mlfq_nrunnable(struct cpu *c)
+{
+  return c->rq.nproc;
+}
+
+// Lend p the level of an mlfq waiter, or level 0 if the waiter
+// is in a class of higher precedence.
+static int
+mlfq_inherit(struct proc *p, struct proc *from)
+{
+  int lev = 0;
+
+  if (from->sclass == &mlfq_class)
+    lev = level(from);
+  if (lev >= level(p))
+    return 0;
+  p->mlfq.ilevel = lev;
+  trace(SEV_PRIO, p, lev);
+  return 1;
+}
+
+static void
+mlfq_restore(struct proc *p)
+{
+  p->mlfq.ilevel = NLEVEL;
+  trace(SEV_PRIO, p, level(p));
+}
+
+void
+mlfq_getparam(struct mlfqparam *mp)
+{
+  *mp = mlfq.param;
+}
+
+// Replace the tunables with mp, or return -1 if they are not valid.
+// Processes queued at levels that no longer exist move to the
+// lowest remaining one. Caller holds ptable.lock.
+int
+mlfq_setparam(struct mlfqparam *mp)
+{
+  struct cpu *c;
+  struct runq *rq;
+  struct proc *p;
+  int lev, last;
+
+  if (mp->nlevel < 1 || mp->nlevel > NLEVEL || mp->boost < 0
+     || mp->aging < 0 || (mp->groupfair != 0 && mp->groupfair != 1))
+    return -1;
+  for (lev = 0; lev < mp->nlevel; lev++) {
+    if (mp->quantum[lev] < 1)
+      return -1;
+    if (lev < mp->nlevel - 1 && mp->allotment[lev] < mp->quantum[lev])
+      return -1;
+  }
+
+  last = mp->nlevel - 1;
+  for (c = cpus; c < &cpus[ncpu]; c++) {
+    rq = &c->rq;
+    for (lev = mp->nlevel; lev < NLEVEL; lev++) {
+      while ((p = rq->head[lev]) != 0) {
+        rqunlink(rq, p, lev);
+        p->mlfq.priority = last;
+        p->mlfq.tick = 0;
+        p->mlfq.runticks = 0;
+        rqappend(rq, p, last);
+      }
+    }
+  }
+  mlfq.param = *mp;
+  return 0;
+}
+
+struct sched_class mlfq_class = {
+  .name = "mlfq",
+  .init = mlfq_init,
+  .enqueue = mlfq_enqueue,
+  .dequeue = mlfq_dequeue,
+  .pick_next = mlfq_pick,
+  .tick = mlfq_tick,
+  .yield = mlfq_yield,
+  .nrunnable = mlfq_nrunnable,
+  .charge = mlfq_charge,
+  .inherit = mlfq_inherit,
+  .restore = mlfq_restore,
+};
@@ -0,0 +1,14 @@
+// Tunables of the mlfq scheduler, see getmlfqparam() and
+// setmlfqparam(). Needs param.h for NLEVEL.
+struct mlfqparam {
+  int nlevel;              // levels in use, 1..NLEVEL
+  int quantum[NLEVEL];     // ticks a process runs per slice at a level
+  int allotment[NLEVEL];   // ticks at a level before moving down;
+                           //  unused for the lowest level
+  int boost;               // ticks between priority boosts, 0 for never
+  int aging;               // ticks a queued process waits at a level
+                           //  before it moves up one; 0 to use the
+                           //  global boost instead
+  int groupfair;           // 1 to share each level fairly between
+                           //  thread groups, then between threads
+};
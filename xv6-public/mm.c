@@ -0,0 +1,96 @@
+//
+// Address spaces
+//
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "mm.h"
+
+struct {
+  struct spinlock lock;
+  struct mm mm[NPROC];
+} mmtable;
+
+void
+mminit(void)
+{
+  struct mm *mm;
+
+  initlock(&mmtable.lock, "mmtable");
+  for(mm = mmtable.mm; mm < mmtable.mm + NPROC; mm++)
+    initsleeplock(&mm->lock, "mm");
+}
+
+// Allocate an address space around page table pgdir.
+struct mm*
+mmalloc(pde_t *pgdir)
+{
+  struct mm *mm;
+
+  acquire(&mmtable.lock);
+  for(mm = mmtable.mm; mm < mmtable.mm + NPROC; mm++){
+    if(mm->ref == 0){
+      mm->ref = 1;
+      release(&mmtable.lock);
+      mm->pgdir = pgdir;
+      mm->sz = 0;
+      mm->heap = 0;
+      mm->stack = 0;
+      mm->maxtid = 0;
+      memset(mm->thread, 0, sizeof(mm->thread));
+      mm->nthread = 1;
+      return mm;
+    }
+  }
+  release(&mmtable.lock);
+  return 0;
+}
+
+// Increment ref count for mm.
+struct mm*
+mmdup(struct mm *mm)
+{
+  acquire(&mmtable.lock);
+  if(mm->ref < 1)
+    panic("mmdup");
+  mm->ref++;
+  release(&mmtable.lock);
+  return mm;
+}
+
+// Drop a reference to mm. The last one frees the page table,
+// which nobody may be running on any more.
+void
+mmput(struct mm *mm)
+{
+  pde_t *pgdir;
+
+  acquire(&mmtable.lock);
+  if(mm->ref < 1)
+    panic("mmput");
+  if(--mm->ref > 0){
+    release(&mmtable.lock);
+    return;
+  }
+  pgdir = mm->pgdir;
+  mm->pgdir = 0;
+  release(&mmtable.lock);
+  freevm(pgdir);
+}
+
+// Lock mm. It is held for short stretches of page table work, so
+// spin while the holder is running before going to sleep.
+void
+mmlock(struct mm *mm)
+{
+  acquiresleepspin(&mm->lock);
+}
+
+void
+mmunlock(struct mm *mm)
+{
+  releasesleep(&mm->lock);
+}
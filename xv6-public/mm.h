@@ -0,0 +1,16 @@
+// Address space, shared by the threads of a process.
+// The user stack of the main thread sits at stack; the stack of
+// thread tid is the page at stack - tid*PGSIZE.
+struct mm {
+  int ref;                // threads using it, guarded by mmtable.lock
+  struct sleeplock lock;  // guards pgdir, heap, stack and maxtid
+  pde_t *pgdir;           // page table
+  uint sz;                // user addresses are below sz
+  uint heap;              // top of heap
+  uint stack;             // bottom of the main thread's stack
+  int maxtid;             // thread stacks allocated below stack
+
+  // Guarded by wait_lock (proc.c).
+  struct proc *thread[NTHREAD]; // threads by tid, slot 0 unused
+  int nthread;            // threads that have not exited
+};
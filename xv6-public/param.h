@@ -1,4 +1,5 @@
 #define NPROC        64  // maximum number of processes
+#define NTHREAD      64  // maximum threads per process, tid 0 unused
 #define KSTACKSIZE 4096  // size of per-process kernel stack
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
@@ -11,4 +12,5 @@
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
 #define FSSIZE       40000  // size of file system in blocks
+#define NLEVEL        8  // max number of MLFQ priority levels
 
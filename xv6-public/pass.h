@@ -0,0 +1,15 @@
+// Stride scheduling arithmetic, shared by stride.c and the
+// test_stridesim user program.
+//
+// Pass values are 64-bit virtual time. A client holding t tickets
+// advances by STRIDE1 / t per quantum; STRIDE1 is large enough that
+// truncating the division costs less than one part in a million
+// for up to MAXTICKETS tickets, and uint (not 64-bit) division
+// is all it takes. Pass values are compared by their difference,
+// so they may wrap around.
+#define STRIDE1  (1U << 30)
+
+#define stridefor(tickets)  (STRIDE1 / (uint)(tickets))
+
+// Is pass value a before b?
+#define passbefore(a, b)  ((long long)((a) - (b)) < 0)
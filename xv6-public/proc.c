@@ -4,174 +4,236 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "x86.h"
+#include "traps.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "sleeplock.h"
+#include "mm.h"
+#include "cpustat.h"
+#include "sched.h"
+#include "mlfqparam.h"
+#include "schedtrace.h"
 
 #define DEBUG 0
 #define THREADDEBUG 0
 
-
-const int LIMITTICKETS = 800;
-const int MAXTICKETS = 1000;
-const int STRIDE = 10000;
-
+// ptable.lock is the scheduler lock. It guards the run queues and
+// class state and every change of p->state, and is held across
+// the switch into and out of a process.
+//
+// wait_lock guards the process tree: p->parent, and finding and
+// freeing UNUSED and ZOMBIE procs. A change of p->state to or from
+// UNUSED, EMBRYO or ZOMBIE holds both locks, so holding either is
+// enough to tell whether a proc is in use or has exited. fork(),
+// exit() and wait() scan the table under wait_lock alone, and so
+// do not hold up scheduling on other cpus.
+//
+// wait_lock also guards the thread tables of address spaces
+// (mm->thread, mm->nthread) and the detached flags of threads.
+//
+// Lock order is an mm lock (mm.h), then wait_lock, then
+// ptable.lock, then a wait queue bucket lock or the stride class
+// lock. A futex bucket lock (futex.c) comes before ptable.lock.
 struct {
   struct spinlock lock;
-  struct spinlock slock;
   struct proc proc[NPROC];
-  struct pqstride stride;
-  struct mlfq mlfq;
 } ptable;
 
-int
-comparenode(struct proc *low, struct proc *high)
+struct spinlock wait_lock;
+
+// Scheduling classes in order of precedence.
+struct sched_class *sched_classes[] = {
+  &edf_class,
+  &stride_class,
+  &mlfq_class,
+  0,
+};
+
+// Sleeping processes are linked into a hash table of wait queues
+// keyed by chan, so a wakeup only looks at processes that can be
+// waiting on it. Each bucket has its own lock.
+//
+// Lock order is ptable.lock before a bucket lock. A waker takes
+// its sleepers off the bucket under the bucket lock alone and only
+// then acquires ptable.lock to make them RUNNABLE. That cannot miss
+// a sleeper: sleep() links itself while holding ptable.lock and
+// keeps holding it until sched() has switched away. A SLEEPING
+// process with p->chan == 0 has been taken off by a waker that is
+// about to wake it.
+#define NWAITQ 64
+
+struct waitq {
+  struct spinlock lock;
+  struct proc *head;
+};
+
+static struct waitq waitq[NWAITQ];
+
+static void exitproc(struct proc*);
+
+static struct proc *initproc;
+
+int nextpid = 1;
+extern void forkret(void);
+extern void trapret(void);
+
+static void wakeup1(void *chan);
+static int wqremove(struct proc *p);
+
+// Mark p RUNNABLE and hand it to its scheduling class.
+// flags is a set of ENQ_ bits (sched.h).
+// Caller holds ptable.lock.
+static void
+makerunnable(struct proc *p, int flags)
 {
-  return (low->u1.passvalue < high->u1.passvalue);
+  p->state = RUNNABLE;
+  p->sclass->enqueue(p, flags);
+  trace((flags & ENQ_WAKEUP) ? SEV_WAKEUP : SEV_ENQUEUE, p, flags);
 }
 
-void
-swap(struct proc** p1, struct proc** p2)
+// Take a RUNNABLE p off its class's run queue, if it is queued.
+// Caller holds ptable.lock.
+static void
+dequeue(struct proc *p)
+{
+  p->sclass->dequeue(p);
+}
+
+// Let p's class drop what p holds there, because p is moving to
+// another class or exiting. Caller holds ptable.lock.
+static void
+leaveclass(struct proc *p)
 {
-  struct proc* tmp = *p1;
-  *p1 = *p2;
-  *p2 = tmp;
+  if (p->sclass->leave)
+    p->sclass->leave(p);
 }
 
+// Move p into scheduling class sc, or restart its class state if
+// it is there already. A RUNNABLE p is re-queued in its new class.
+// Caller holds ptable.lock.
 void
-shiftup(int index)
+setclass(struct proc *p, struct sched_class *sc)
 {
-  if (index <= 1) return ;
-  int parent = index >> 1;
-  if (comparenode(ptable.stride.p[index], ptable.stride.p[parent])) {
-    swap(&ptable.stride.p[parent], &ptable.stride.p[index]);
-    shiftup(parent);
-  }
+  int runnable = (p->state == RUNNABLE);
+
+  if (runnable)
+    dequeue(p);
+  if (p->sclass != sc)
+    leaveclass(p);
+  p->sclass = sc;
+  sc->init(p);
+  if (runnable)
+    sc->enqueue(p, 0);
 }
 
+// The current process waits for a sleeplock that p holds. Lend p
+// our priority, through its class, until it releases its last
+// sleeplock (restoreprio()).
 void
-shiftdown(int index)
+inheritprio(struct proc *p)
 {
-  int l = index * 2;
-  int r = index * 2 + 1;
-  int imin = index;
+  int runnable;
 
-  if (l <= ptable.stride.cntproc
-      && comparenode(ptable.stride.p[l], ptable.stride.p[imin])) {
-    imin = l;
+  acquire(&ptable.lock);
+  if (p->sclass->inherit) {
+    runnable = (p->state == RUNNABLE);
+    if (runnable)
+      dequeue(p);
+    if (p->sclass->inherit(p, myproc())) {
+      p->inherited = 1;
+      mycpu()->ninherit++;
+    }
+    if (runnable)
+      p->sclass->enqueue(p, 0);
   }
+  release(&ptable.lock);
+}
 
-  if (r <= ptable.stride.cntproc
-      && comparenode(ptable.stride.p[r], ptable.stride.p[imin])) {
-    imin = r;
-  }
+// The current process released its last sleeplock; give back
+// what waiters lent it.
+void
+restoreprio(void)
+{
+  struct proc *p = myproc();
 
-  if (imin == index) return ;
-  swap(&ptable.stride.p[imin], &ptable.stride.p[index]);
-  shiftdown(imin);
+  acquire(&ptable.lock);
+  if (p->sclass->restore)
+    p->sclass->restore(p);
+  p->inherited = 0;
+  release(&ptable.lock);
 }
 
+// Send a reschedule interrupt to c if it is halted.
+// Caller holds ptable.lock.
 void
-push(struct proc *p)
+kick(struct cpu *c)
 {
-  acquire(&ptable.slock);
-  int i = ++ptable.stride.cntproc;
-  // cprintf("[PUSH] %d %d\n", p->pid, i);
-  ptable.stride.p[i] = p;
-  shiftup(i);
-  release(&ptable.slock);
+  if (c->idle && c != mycpu())
+    lapicipi(c->apicid, T_IRQ0 + IRQ_RESCHED);
 }
 
+// Make c give up its process at its next trap.
+// Caller holds ptable.lock.
 void
-pop(void)
+resched(struct cpu *c)
 {
-  int i = ptable.stride.cntproc;
-  if (i == 0) return;
-  swap(&ptable.stride.p[1], &ptable.stride.p[i]);
-  ptable.stride.p[i] = 0;
-  ptable.stride.cntproc--;
-  shiftdown(1);
+  c->resched = 1;
+  if (c != mycpu())
+    lapicipi(c->apicid, T_IRQ0 + IRQ_RESCHED);
 }
 
-
-void
-pop_proc(struct proc* p)
+// Has this cpu been asked to give up its process?
+int
+needresched(void)
 {
-  
-  if (p->state == ZOMBIE || p->state == UNUSED) return ;
-  
-  int i;
-  int find = -1;
-  for (i = 1; i < NPROC; i++) {
-    if (ptable.stride.p[i] == p) {
-      find = i;
-      break;
-    }
-  }
-  acquire(&ptable.slock);
-  i = ptable.stride.cntproc;
-  if (find == -1 || i == 0) return ;
-  // pop find
-  swap(&ptable.stride.p[find], &ptable.stride.p[i]);
-  ptable.stride.p[i] = 0;
-  ptable.stride.cntproc--;
-  shiftdown(find);
-  release(&ptable.slock);
+  int r;
+
+  pushcli();
+  r = mycpu()->resched;
+  popcli();
+  return r;
 }
 
+// Get an idle cpu going on p, which was just queued: the cpu it is
+// queued on if that one is idle, else any idle cpu that may pick or
+// steal it. Yields are not kicked: their cpu is about to schedule,
+// and a class that queues them elsewhere kicks that cpu itself.
+// Caller holds ptable.lock.
 void
-boost(void)
+kickidle(struct proc *p)
 {
-#if DEBUG
-  cprintf("[do boosting]\n");
-#endif
-  ptable.mlfq.priority = 0;
-  ptable.mlfq.index = 0;
-  ptable.mlfq.tick = 0;
-
-  struct proc* p;
-  for (p = ptable.proc; p< &ptable.proc[NPROC]; p++) {
-    if (p->type == 'm' && p->state == RUNNABLE) {
-      p->u1.priority = 0;
-      p->u2.tick = 0;
-      p->u3.runticks = 0;
+  struct cpu *c;
+
+  if (p->cpu && p->cpu->idle && cpuallowed(p, p->cpu)) {
+    kick(p->cpu);
+    return;
+  }
+  for (c = cpus; c < &cpus[ncpu]; c++) {
+    if (c->idle && cpuallowed(p, c)) {
+      kick(c);
+      return;
     }
   }
 }
 
-int
-ticklimit(int priority)
-{
-  if (priority == 0) return 1;
-  if (priority == 1) return 2;
-  if (priority == 2) return 4;
-  panic("ticklimit get wrong priority");
-  return -1;
-}
-
-int
-runlimit(int priority)
+// Wake a sleeping p.
+static void
+wakeproc(struct proc *p)
 {
-  if (priority == 0) return 5;
-  if (priority == 1) return 10;
-  panic("run limit get wrong priority");
-  return -1;
+  makerunnable(p, ENQ_WAKEUP);
+  kickidle(p);
 }
 
-void deallocthread(struct proc* p, int pid);
-void exitproc(struct proc* p);
-
-static struct proc *initproc;
-
-int nextpid = 1;
-extern void forkret(void);
-extern void trapret(void);
-
-static void wakeup1(void *chan);
-
 void
 pinit(void)
 {
+  int i;
+
   initlock(&ptable.lock, "ptable");
+  initlock(&wait_lock, "wait_lock");
+  strideinit();
+  for (i = 0; i < NWAITQ; i++)
+    initlock(&waitq[i].lock, "waitq");
 }
 
 // Must be called with interrupts disabled
@@ -214,7 +276,19 @@ myproc(void) {
 }
 
 //PAGEBREAK: 32
-// Look in the process table for an UNUSED proc.
+// Mark p UNUSED. Takes wait_lock and ptable.lock.
+static void
+setunused(struct proc *p)
+{
+  acquire(&wait_lock);
+  acquire(&ptable.lock);
+  p->state = UNUSED;
+  release(&ptable.lock);
+  release(&wait_lock);
+}
+
+// Look in the process table for an UNUSED proc, or for a
+// detached thread that has exited and left its slot to us.
 // If found, change state to EMBRYO and initialize
 // state required to run in the kernel.
 // Otherwise return 0.
@@ -223,33 +297,40 @@ allocproc(void)
 {
   struct proc *p;
   char *sp;
+  int reuse;
 
-  acquire(&ptable.lock);
+  acquire(&wait_lock);
 
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if(p->state == UNUSED)
+    if(p->state == UNUSED || (p->state == ZOMBIE && p->detached))
       goto found;
 
-  release(&ptable.lock);
+  release(&wait_lock);
   return 0;
 
 found:
+  // Once we hold ptable.lock, an exited thread is off its cpu
+  // and its kernel stack is ours.
+  reuse = (p->state == ZOMBIE);
+  acquire(&ptable.lock);
   p->state = EMBRYO;
+  release(&ptable.lock);
   p->pid = nextpid++;
   p->main_thread = p;
   p->guard = 0;
-  p->cguard = 0;
   p->eguard = 0;
-  p->maxtid = 0;
-  int i;
-  for (i = 0; i < 64; i++) {
-    p->hasThread[i] = 0;
-  }
-  release(&ptable.lock);
+  p->detached = 0;
+  p->tid = 0;
+  release(&wait_lock);
+
+  // An exited detached thread kept its address space until now.
+  if(reuse)
+    mmput(p->mm);
+  p->mm = 0;
 
   // Allocate kernel stack.
-  if((p->kstack = kalloc()) == 0){
-    p->state = UNUSED;
+  if(!reuse && (p->kstack = kalloc()) == 0){
+    setunused(p);
     return 0;
   }
   sp = p->kstack + KSTACKSIZE;
@@ -267,10 +348,20 @@ found:
   p->context = (struct context*)sp;
   memset(p->context, 0, sizeof *p->context);
   p->context->eip = (uint)forkret;
-  p->type = 'm';
-  p->u1.priority = 0;
-  p->u2.tick = 0;
-  p->u3.runticks = 0;
+  p->sclass = &mlfq_class;
+  mlfq_class.init(p);
+  p->stride.hidx = 0;
+  p->alltickets = 0;
+  p->cpu = 0;
+  p->lastrun = 0;
+  p->handoff = 0;
+  p->gang = 0;
+  p->affinity = ~0;
+  p->nsleeplock = 0;
+  p->inherited = 0;
+  p->faddr = 0;
+  p->fnext = 0;
+  p->timer = 0;
   return p;
 }
 
@@ -285,12 +376,12 @@ userinit(void)
   p = allocproc();
   
   initproc = p;
-  if((p->pgdir = setupkvm()) == 0)
+  if((p->pgdir = setupkvm()) == 0 || (p->mm = mmalloc(p->pgdir)) == 0)
     panic("userinit: out of memory?");
   inituvm(p->pgdir, _binary_initcode_start, (int)_binary_initcode_size);
-  p->sz = PGSIZE;
-  p->heap = PGSIZE;
-  p->stack = KERNBASE - PGSIZE;
+  p->mm->sz = PGSIZE;
+  p->mm->heap = PGSIZE;
+  p->mm->stack = KERNBASE - PGSIZE;
   memset(p->tf, 0, sizeof(*p->tf));
   p->tf->cs = (SEG_UCODE << 3) | DPL_USER;
   p->tf->ds = (SEG_UDATA << 3) | DPL_USER;
@@ -309,37 +400,38 @@ userinit(void)
   // because the assignment might not be atomic.
   acquire(&ptable.lock);
 
-  p->state = RUNNABLE;
+  makerunnable(p, 0);
+  kickidle(p);
 
   release(&ptable.lock);
 }
 
-// Grow current process's memory by n bytes.
-// Return 0 on success, -1 on failure.
+// Grow current process's heap by n bytes.
+// Return the old top of heap, or -1 on failure.
 int
 growproc(int n)
 {
-
   struct proc *curproc = myproc();
-  struct proc *mthread = curproc->main_thread;
-  while((__sync_val_compare_and_swap(&mthread->cguard, 0, 1)) == 1);
-  uint sz;
-#if THREADDEBUG
-  cprintf("[PID : %d] heap : %d\n", mthread->pid, mthread->heap);
-#endif
-  sz = mthread->heap;
+  struct mm *mm = curproc->mm;
+  uint sz, old;
+
+  mmlock(mm);
+  old = sz = mm->heap;
   if(n > 0){
-    if((sz = allocuvm(mthread->pgdir, sz, sz + n)) == 0)
+    if((sz = allocuvm(mm->pgdir, sz, sz + n)) == 0){
+      mmunlock(mm);
       return -1;
+    }
   } else if(n < 0){
-    if((sz = deallocuvm(mthread->pgdir, sz, sz + n)) == 0)
+    if((sz = deallocuvm(mm->pgdir, sz, sz + n)) == 0){
+      mmunlock(mm);
       return -1;
+    }
   }
-
-  mthread->heap = sz;
-  __sync_fetch_and_sub(&mthread->cguard, 1);
+  mm->heap = sz;
+  mmunlock(mm);
   switchuvm(curproc);
-  return 0;
+  return old;
 }
 
 // Create a new process copying p as the parent.
@@ -351,35 +443,37 @@ fork(void)
   int i, pid;
   struct proc *np;
   struct proc *curproc = myproc();
-  struct proc *mthread = curproc->main_thread;
+  struct mm *mm = curproc->mm;
+  pde_t *pgdir;
+  uint heap, stack;
+
   // Allocate process.
   if((np = allocproc()) == 0){
     return -1;
   }
-  // Copy process state from proc.
-#if THREADEBUG
-  cprintf("%d %d %d %d %d\n", 
-      mthread->pgdir,
-      mthread->stack, 
-      mthread->stack - (mthread->maxtid * PGSIZE),
-      curproc->stack, 
-      KERNBASE - (3 * PGSIZE) 
-  );
-#endif
-
-  if((np->pgdir = copyuvm(mthread->pgdir, mthread->heap, curproc->stack)) == 0){
+  // Copy process state from proc: the heap and the stacks of
+  // all our threads, which become the child's main stack.
+  mmlock(mm);
+  heap = mm->heap;
+  stack = mm->stack - mm->maxtid * PGSIZE;
+  pgdir = copyuvm(mm->pgdir, heap, stack);
+  mmunlock(mm);
+  if(pgdir == 0 || (np->mm = mmalloc(pgdir)) == 0){
+    if(pgdir)
+      freevm(pgdir);
     kfree(np->kstack);
     np->kstack = 0;
-    np->state = UNUSED;
+    setunused(np);
     return -1;
   }
-#if THREADEBUG
-  cprintf("[FORKEND]\n");
-#endif
-  np->sz = mthread->sz;
-  np->heap = mthread->heap;
-  np->stack = mthread->stack - (curproc->maxtid * PGSIZE);
+  np->pgdir = pgdir;
+  np->mm->heap = heap;
+  np->mm->stack = stack;
+  np->mm->sz = mm->sz;
+  acquire(&wait_lock);
   np->parent = curproc;
+  release(&wait_lock);
+  np->affinity = curproc->affinity;
   *np->tf = *curproc->tf;
 
   // Clear %eax so that fork returns 0 in the child.
@@ -395,7 +489,8 @@ fork(void)
 
   acquire(&ptable.lock);
 
-  np->state = RUNNABLE;
+  makerunnable(np, 0);
+  kickidle(np);
 
   release(&ptable.lock);
 
@@ -450,23 +545,24 @@ exit(void)
 
   struct proc *curproc = myproc();
   struct proc *p;
+  int zombies = 0;
  
   struct proc *mthread = curproc->main_thread; 
   int exlock = __sync_fetch_and_add(&mthread->guard, 1);
   while (exlock > 0) {
     yield();
   }
-  if (curproc->type == 's') { 
-    ptable.stride.total_tickets -= curproc->main_thread->alltickets;
+  if (mthread->alltickets) {
+    stride_reserve(mthread->alltickets, 0);
+    mthread->alltickets = 0;
   }
+  acquire(&ptable.lock);
+  leaveclass(curproc);
+  release(&ptable.lock);
 
  if(curproc == initproc)
     panic("init exiting");
   deallocthread(curproc, curproc->pid);
-  
-  if (curproc->type == 's') {
-    pop_proc(curproc);
-  }
 
   // Parent might be sleeping in wait().
   int fd;
@@ -478,29 +574,32 @@ exit(void)
       curproc->ofile[fd] = 0;
     }
   }
-  curproc->main_thread->hasThread[curproc->tid] = 0;
+  acquire(&wait_lock);
+
+  // Pass abandoned children to init.
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if(p->parent == curproc){
+      p->parent = initproc;
+      if(p->state == ZOMBIE)
+        zombies = 1;
+    }
+  }
+
   acquire(&ptable.lock);
-  
   wakeup1(curproc->parent);
+  if (zombies)
+    wakeup1(initproc);
 #if THREADEBUG
   cprintf("wakeup pid : %d\n", curproc->parent->pid);
   cprintf("exit : %d\n", curproc->pid); 
   printallstate();
   cprintf("exit end : %d\n", curproc->pid);
 #endif
-  
-  // Pass abandoned children to init.
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->parent == curproc){
-      p->parent = initproc;
-      if(p->state == ZOMBIE)
-        wakeup1(initproc);
-    }
-  }
 
   // Jump into the scheduler, never to return.
   curproc->eguard = 1;
   curproc->state = ZOMBIE;
+  release(&wait_lock);
   sched();
   panic("zombie exit");
 }
@@ -513,7 +612,10 @@ wait(void)
   struct proc *p;
   int havekids, pid;
   struct proc *curproc = myproc();
-  acquire(&ptable.lock);
+  char *kstack;
+  struct mm *mm;
+
+  acquire(&wait_lock);
   for(;;){
     // Scan through table looking for exited children.
     havekids = 0;
@@ -530,133 +632,170 @@ wait(void)
 #if THREADEBUG
         cprintf("pid : %d\n", pid);
 #endif
-        kfree(p->kstack);
+        kstack = p->kstack;
+        mm = p->mm;
+        // Once we hold ptable.lock, p is off its cpu and
+        // no longer uses its kernel stack.
+        acquire(&ptable.lock);
         p->kstack = 0;
-        freevm(p->pgdir);
+        p->mm = 0;
+        p->pgdir = 0;
         p->pid = 0;
         p->parent = 0;
         p->name[0] = 0;
         p->killed = 0;
         p->state = UNUSED;
         release(&ptable.lock);
+        release(&wait_lock);
+        kfree(kstack);
+        mmput(mm);
         return pid;
       }
     }
 
     // No point waiting if we don't have any children.
     if(!havekids || curproc->killed){
-      release(&ptable.lock);
+      release(&wait_lock);
       return -1;
     }
 
     // Wait for children to exit.  (See wakeup1 call in proc_exit.)
 
-    sleep(curproc, &ptable.lock);  //DOC: wait-sleep
+    sleep(curproc, &wait_lock);  //DOC: wait-sleep
   }
 }
 
 
-void check_down_priority(struct proc* p) {
-  if (p->u1.priority > 1) return ;
-  if (p->u3.runticks >= runlimit(p->u1.priority)) {
-#if DEBUG
-    cprintf("PRIORITY DOWN\n");
-#endif
-    p->u1.priority++;
-    p->u2.tick = 0;
-    p->u3.runticks = 0;
-  }
-}
-  
-void
-mlfq_run(struct cpu* c)
+// Index of p's class in sched_classes.
+static int
+classidx(struct proc *p)
 {
-  struct proc* p;
+  int i;
 
-  if (ptable.mlfq.tick >= 100) boost();
+  for (i = 0; sched_classes[i] != p->sclass; i++)
+    ;
+  return i;
+}
 
-  int i;
-  int icur = 0;
-  int min = 2;
-
-  for (i = icur; i < NPROC; i++) {
-    p = &ptable.proc[i];
-    if (p->type == 'm' && p->state == RUNNABLE) {
-      if (min > p->u1.priority) {
-        min = p->u1.priority;
-      }
-    }
+// Record that p is about to run on c.
+static void
+setcpu(struct proc *p, struct cpu *c)
+{
+  if (p->cpu && p->cpu != c) {
+    c->nmigrate++;
+    trace(SEV_MIGRATE, p, p->cpu - cpus);
   }
+  p->cpu = c;
+  trace(SEV_SWITCHIN, p, classidx(p));
+}
 
-  if (ptable.mlfq.priority != min) {
-    // Level Change
-    ptable.mlfq.priority = min;
-    ptable.mlfq.index = 0;
-  }
+// Run p, picked by its class, on c until it gives the cpu back.
+static void
+run(struct cpu *c, struct proc *p)
+{
+  c->proc = p;
+  c->resched = 0;
+  setcpu(p, c);
+  switchuvm(p);
+  p->state = RUNNING;
+  swtch(&(c->scheduler), p->context);
+  switchkvm();
+  // p may have handed the cpu to another process.
+  trace(SEV_SWITCHOUT, c->proc, c->proc->state);
+  c->proc->lastrun = ticks;
+  c->proc = 0;
+}
 
-  icur = ptable.mlfq.index;
-  int find = 0;
+// Dequeue a RUNNABLE thread of gang for c, charged to its class,
+// or return 0 if there is none.
+static struct proc*
+gangpick(struct cpu *c, struct proc *gang)
+{
+  struct proc *p;
 
-  for (i = icur; i < NPROC; i++) {
-    p = &ptable.proc[i];
-    if (p->type == 'm' && p->state == RUNNABLE
-        && p->u1.priority == ptable.mlfq.priority) {
-      find = 1;
-      ptable.mlfq.index = i + 1;
-      break;
-    }
+  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++) {
+    if (p->state != RUNNABLE || p->main_thread != gang || !cpuallowed(p, c))
+      continue;
+    if (p->sclass == &edf_class && p->edf.throttled)
+      continue;
+    dequeue(p);
+    if (p->sclass->charge)
+      p->sclass->charge(p);
+    c->ngang++;
+    return p;
   }
-  i = 0;
-  if (find) i = NPROC;
-  for (; i < icur; i++) {
-    p = &ptable.proc[i];
-    if (p->type == 'm' && p->state == RUNNABLE
-        && p->u1.priority == ptable.mlfq.priority) {
-      find = 1;
-      ptable.mlfq.index = i + 1;
+  return 0;
+}
+
+// c picked p, a thread of a gang. For each RUNNABLE sibling, ask
+// one other cpu it may run on to run it in the same slice,
+// skipping cpus that are asked already or run a sibling or an
+// edf process.
+static void
+gangrecruit(struct cpu *c, struct proc *p)
+{
+  struct proc *gang = p->main_thread;
+  struct proc *q, *r;
+  struct cpu *o;
+
+  for (q = ptable.proc; q < &ptable.proc[NPROC]; q++) {
+    if (q->state != RUNNABLE || q->main_thread != gang)
+      continue;
+    if (q->sclass == &edf_class && q->edf.throttled)
+      continue;
+    for (o = cpus; o < &cpus[ncpu]; o++) {
+      if (o == c || o->gang == gang || !cpuallowed(q, o))
+        continue;
+      if ((r = o->proc) != 0 && r->state == RUNNING
+          && (r->main_thread == gang || r->sclass == &edf_class))
+        continue;
+      o->gang = gang;
+      resched(o);
       break;
     }
   }
+}
 
-  if (find) {
-    c->proc = p;
-    ptable.mlfq.tick++;
-    p->u2.tick++;
-    p->u3.runticks++;
-#if DEBUG
-    cprintf("schd call %d\n", myproc()->u1.priority);
-#endif
-
-    check_down_priority(p);
+// Number of processes queued in any class that c may pick.
+static int
+nrunnable(struct cpu *c)
+{
+  struct sched_class **sc;
+  int n = 0;
 
-    switchuvm(p);
-    p->state = RUNNING;
-    swtch(&(c->scheduler), p->context);
-    switchkvm();
-    c->proc = 0;
-  }
+  for (sc = sched_classes; *sc; sc++)
+    n += (*sc)->nrunnable(c);
+  return n;
 }
 
-void
-stride_run(struct cpu *c)
-{
-  struct proc* p = ptable.stride.p[1];
-  if (ptable.stride.cntproc > 0) {
-    // p = ptable.stride.p[1];
-    if (p->state != RUNNABLE) { 
-      // pop_proc(p);
-      // push(p);
-      p->u1.passvalue += p->u3.stride;
-      shiftdown(1);
-      return ;
-    }
+// Halt c until an interrupt arrives, because nothing is runnable
+// here. Cpus other than cpu 0, which keeps ticks, also stop their
+// timer; they are woken by a reschedule IPI when work is queued.
+// Called and returns with ptable.lock held.
+static void
+idle(struct cpu *c)
+{
+  uint start;
 
-    c->proc = p;
-    switchuvm(p);
-    p->state = RUNNING;
-    swtch(&(c->scheduler), p->context);
-    switchkvm();
-  }
+  c->idle = 1;
+  c->nidle++;
+  start = ticks;
+
+  // Keep interrupts off until hlt, so that a kick sent
+  // once we release ptable.lock is not lost.
+  pushcli();
+  release(&ptable.lock);
+  if (c != &cpus[0])
+    lapictimer(0);
+  stihlt();
+  cli();
+  if (c != &cpus[0])
+    lapictimer(1);
+  popcli();
+
+  acquire(&ptable.lock);
+  c->idle = 0;
+  c->idleticks += ticks - start;
 }
 
 //PAGEBREAK: 42
@@ -671,27 +810,33 @@ void
 scheduler(void)
 {
   struct cpu *c = mycpu();
+  struct sched_class **sc;
+  struct proc *p;
+
   c->proc = 0;
-  boost(); 
   for(;;){
     // Enable interrupts on this processor.
     sti();
 
-    // Loop over process table looking for process to run.
+    // Join a gang we were asked to run, else ask the classes
+    // in order of precedence for a process to run.
     acquire(&ptable.lock);
-    if (ptable.stride.cntproc > 0) {
-      if (ptable.mlfq.passvalue <= ptable.stride.p[1]->u1.passvalue) {
-        // MLFQ using STRIDE
-        ptable.mlfq.passvalue += (STRIDE / (MAXTICKETS - ptable.stride.total_tickets));
-        mlfq_run(c);
-      } else {
-        // STRIDE using STRIDE
-        stride_run(c);
-      }
-    } else {
-      // JUST MLFQ
-      mlfq_run(c);
-    }    
+    p = 0;
+    if (c->gang) {
+      p = gangpick(c, c->gang);
+      c->gang = 0;
+    }
+    if (p == 0) {
+      for (sc = sched_classes; *sc; sc++)
+        if ((p = (*sc)->pick_next(c)) != 0)
+          break;
+      if (p && p->main_thread->gang)
+        gangrecruit(c, p);
+    }
+    if (p)
+      run(c, p);
+    else if (nrunnable(c) == 0)
+      idle(c);
     release(&ptable.lock);
   }
 }
@@ -721,26 +866,193 @@ sched(void)
   mycpu()->intena = intena;
 }
 
+// Like sched(), but switch straight to p, a RUNNABLE process
+// sharing our address space, instead of going through
+// scheduler(). p runs on the rest of our slice: its class does
+// not charge it a pick.
+static void
+handoff(struct proc *p)
+{
+  int intena;
+  struct cpu *c = mycpu();
+  struct proc *cur = c->proc;
+  if(!holding(&ptable.lock))
+    panic("handoff ptable.lock");
+  if(c->ncli != 1)
+    panic("handoff locks");
+  if(cur->state == RUNNING)
+    panic("handoff running");
+  if(readeflags()&FL_IF)
+    panic("handoff interruptible");
+  dequeue(p);
+  trace(SEV_SWITCHOUT, cur, cur->state);
+  cur->lastrun = ticks;
+  c->proc = p;
+  c->nhandoff++;
+  setcpu(p, c);
+  switchuvm(p);
+  p->state = RUNNING;
+  intena = c->intena;
+  swtch(&cur->context, p->context);
+  mycpu()->intena = intena;
+}
+
+// Can the current process hand its cpu to p?
+static int
+canhandoff(struct proc *p)
+{
+  struct proc *cur = myproc();
+
+  if (p == 0 || p == cur || p->state != RUNNABLE || p->mm != cur->mm)
+    return 0;
+  if (!cpuallowed(p, mycpu()))
+    return 0;
+  // Stay within the class, and leave throttled edf threads be.
+  if (p->sclass != cur->sclass)
+    return 0;
+  return p->sclass != &edf_class || !p->edf.throttled;
+}
+
 // Give up the CPU for one scheduling round.
 void
 yield(void)
 {
-  if (myproc()->cguard == 1) return ;
   acquire(&ptable.lock);  //DOC: yieldlock
-  if (myproc()->type == 'm') myproc()->u2.tick = 0;
-  else if (myproc()->type == 's') {
-    //struct proc* p = ptable.stride.p[1];
-    struct proc* p = myproc();
-    //pop_proc(p);
-    //push(p);
-    p->u1.passvalue += p->u3.stride;
-    shiftdown(1);
-  }
-  myproc()->state = RUNNABLE;
+  myproc()->handoff = 0;
+  myproc()->sclass->yield(myproc());
+  makerunnable(myproc(), 0);
   sched();
   release(&ptable.lock);
 }
 
+// The live process with the given pid, or the caller if pid is 0.
+// Caller holds ptable.lock.
+static struct proc*
+findproc(int pid)
+{
+  struct proc *p;
+
+  if (pid == 0)
+    return myproc();
+  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    if (p->pid == pid && p->state != UNUSED && p->state != ZOMBIE)
+      return p;
+  return 0;
+}
+
+// Restrict process or thread pid, or the caller if pid is 0, to
+// the cpus in mask: bit i stands for cpu i. A RUNNABLE process is
+// re-queued where it may run, and a running one is moved off a
+// cpu it may no longer use. A caller that shut itself out of its
+// cpu has moved by the time this returns.
+int
+sched_setaffinity(int pid, uint mask)
+{
+  struct proc *p;
+  int move;
+
+  mask &= (1 << ncpu) - 1;
+  if (mask == 0)
+    return -1;
+  acquire(&ptable.lock);
+  if ((p = findproc(pid)) == 0) {
+    release(&ptable.lock);
+    return -1;
+  }
+  p->affinity = mask;
+  if (p->state == RUNNABLE) {
+    dequeue(p);
+    p->sclass->enqueue(p, 0);
+    kickidle(p);
+  } else if (p->state == RUNNING && !cpuallowed(p, p->cpu)) {
+    resched(p->cpu);
+  }
+  move = !cpuallowed(myproc(), mycpu());
+  release(&ptable.lock);
+  if (move)
+    yield();
+  return 0;
+}
+
+// Store the cpu mask of pid, or of the caller if pid is 0, in *mask.
+int
+sched_getaffinity(int pid, uint *mask)
+{
+  struct proc *p;
+
+  acquire(&ptable.lock);
+  if ((p = findproc(pid)) == 0) {
+    release(&ptable.lock);
+    return -1;
+  }
+  *mask = p->affinity & ((1 << ncpu) - 1);
+  release(&ptable.lock);
+  return 0;
+}
+
+// Turn gang scheduling of this process's threads on or off.
+// When one thread is picked to run, other cpus are asked to run
+// its RUNNABLE siblings in the same slice. Picks made for a gang
+// are charged to the thread's class as usual, so a stride group
+// still gets the tickets share_tickets() gave it.
+int
+set_gang(int on)
+{
+  acquire(&ptable.lock);
+  myproc()->main_thread->gang = (on != 0);
+  release(&ptable.lock);
+  return 0;
+}
+
+// Give the cpu to thread, a RUNNABLE thread of this process,
+// and stay RUNNABLE. Returns -1 if thread cannot run now.
+int
+yield_to(thread_t thread)
+{
+  struct proc *cur = myproc();
+  struct proc *p;
+
+  acquire(&ptable.lock);
+  p = findproc(thread);
+  if (!canhandoff(p)) {
+    release(&ptable.lock);
+    return -1;
+  }
+  cur->handoff = 0;
+  cur->sclass->yield(cur);
+  makerunnable(cur, 0);
+  handoff(p);
+  release(&ptable.lock);
+  return 0;
+}
+
+// Let the classes do their timed work. Called by the timer
+// interrupt on cpu 0 after ticks has advanced.
+void
+schedclock(void)
+{
+  struct sched_class **sc;
+
+  for (sc = sched_classes; *sc; sc++) {
+    if ((*sc)->clockdue == 0 || !(*sc)->clockdue())
+      continue;
+    acquire(&ptable.lock);
+    (*sc)->clock();
+    release(&ptable.lock);
+  }
+}
+
+// Timer tick while the current process runs.
+// Give up the cpu if its class says its time is up.
+void
+schedtick(void)
+{
+  struct proc *p = myproc();
+
+  if (p->sclass->tick(p))
+    yield();
+}
+
 // A fork child's very first scheduling by scheduler()
 // will swtch here.  "Return" to user space.
 void
@@ -762,12 +1074,87 @@ forkret(void)
   // Return to "caller", actually trapret (see allocproc).
 }
 
+static struct waitq*
+chanq(void *chan)
+{
+  return &waitq[((uint)chan * 2654435761u) >> 26];
+}
+
+static void
+wqlink(struct waitq *q, struct proc *p)
+{
+  p->wqprev = 0;
+  p->wqnext = q->head;
+  if (q->head)
+    q->head->wqprev = p;
+  q->head = p;
+}
+
+static void
+wqunlink(struct waitq *q, struct proc *p)
+{
+  if (p->wqprev)
+    p->wqprev->wqnext = p->wqnext;
+  else
+    q->head = p->wqnext;
+  if (p->wqnext)
+    p->wqnext->wqprev = p->wqprev;
+  p->wqnext = 0;
+  p->wqprev = 0;
+  p->chan = 0;
+}
+
+// Take the SLEEPING p off its wait queue. Returns 0 if a waker
+// already took it off. Caller holds ptable.lock.
+static int
+wqremove(struct proc *p)
+{
+  struct waitq *q;
+  void *chan;
+  int found = 0;
+
+  if ((chan = p->chan) == 0)
+    return 0;
+  q = chanq(chan);
+  acquire(&q->lock);
+  if (p->chan == chan) {
+    wqunlink(q, p);
+    found = 1;
+  }
+  release(&q->lock);
+  return found;
+}
+
+// Take every process sleeping on chan off its wait queue.
+// Stores them in woken and returns how many there are.
+static int
+wqtake(void *chan, struct proc **woken)
+{
+  struct waitq *q = chanq(chan);
+  struct proc *p, *next;
+  int n = 0;
+
+  acquire(&q->lock);
+  for (p = q->head; p; p = next) {
+    next = p->wqnext;
+    if (p->chan == chan) {
+      wqunlink(q, p);
+      woken[n++] = p;
+    }
+  }
+  release(&q->lock);
+  return n;
+}
+
 // Atomically release lock and sleep on chan.
 // Reacquires lock when awakened.
 void
 sleep(void *chan, struct spinlock *lk)
 {
   struct proc *p = myproc();
+  struct proc *next;
+  struct waitq *q = chanq(chan);
+
   if(p == 0)
     panic("sleep");
 
@@ -776,19 +1163,32 @@ sleep(void *chan, struct spinlock *lk)
 
   // Must acquire ptable.lock in order to
   // change p->state and then call sched.
-  // Once we hold ptable.lock, we can be
-  // guaranteed that we won't miss any wakeup
-  // (wakeup runs with ptable.lock locked),
+  // Once p is on its wait queue, a wakeup
+  // cannot make it RUNNABLE before sched()
+  // has released ptable.lock in the scheduler,
   // so it's okay to release lk.
   if(lk != &ptable.lock){  //DOC: sleeplock0
     acquire(&ptable.lock);  //DOC: sleeplock1
+    acquire(&q->lock);
     release(lk);
+  } else {
+    acquire(&q->lock);
   }
   // Go to sleep.
   p->chan = chan;
   p->state = SLEEPING;
-
-  sched();
+  wqlink(q, p);
+  release(&q->lock);
+
+  // If we just woke a thread of our own process, run it
+  // right away on this cpu. The slot may have been reused
+  // since, so check it still holds the thread we woke.
+  next = p->handoff;
+  p->handoff = 0;
+  if (next && next->pid == p->handoffpid && canhandoff(next))
+    handoff(next);
+  else
+    sched();
 
   // Tidy up.
   p->chan = 0;
@@ -801,25 +1201,56 @@ sleep(void *chan, struct spinlock *lk)
 }
 
 //PAGEBREAK!
+// Wake processes taken off a wait queue.
+// The ptable lock must be held.
+// A thread woken by a sibling is remembered, so that the
+// waker can hand it its cpu if it goes to sleep next. An
+// interrupt handler wakes on nobody's behalf and leaves no hint.
+static void
+wakelist(struct proc **woken, int n)
+{
+  struct proc *cur = mycpu()->intr ? 0 : myproc();
+  int i;
+
+  // A process freed in the meantime is no longer SLEEPING, or
+  // has gone to sleep again and is back on a wait queue.
+  for (i = 0; i < n; i++) {
+    if (woken[i]->state != SLEEPING || woken[i]->chan != 0)
+      continue;
+    wakeproc(woken[i]);
+    if (cur && woken[i]->mm == cur->mm) {
+      cur->handoff = woken[i];
+      cur->handoffpid = woken[i]->pid;
+    }
+  }
+}
+
 // Wake up all processes sleeping on chan.
 // The ptable lock must be held.
 static void
 wakeup1(void *chan)
 {
-  struct proc *p;
+  struct proc *woken[NPROC];
 
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if(p->state == SLEEPING && p->chan == chan)
-      p->state = RUNNABLE;
+  wakelist(woken, wqtake(chan, woken));
 }
 
 // Wake up all processes sleeping on chan.
 void
 wakeup(void *chan)
 {
-  acquire(&ptable.lock);
-  wakeup1(chan);
-  release(&ptable.lock);
+  struct proc *woken[NPROC];
+  int n;
+
+  // Stay on this cpu from taking the sleepers to waking them,
+  // so that the gap is as short as the wait for ptable.lock.
+  pushcli();
+  if ((n = wqtake(chan, woken)) != 0) {
+    acquire(&ptable.lock);
+    wakelist(woken, n);
+    release(&ptable.lock);
+  }
+  popcli();
 }
 
 // Kill the process with the given pid.
@@ -835,8 +1266,8 @@ kill(int pid)
     if(p->pid == pid){
       p->killed = 1;
       // Wake process from sleep if necessary.
-      if(p->state == SLEEPING)
-        p->state = RUNNABLE;
+      if(p->state == SLEEPING && wqremove(p))
+        wakeproc(p);
       release(&ptable.lock);
       return 0;
     }
@@ -872,7 +1303,7 @@ procdump(void)
       state = states[p->state];
     else
       state = "???";
-    cprintf("%d %s %s", p->pid, state, p->name);
+    cprintf("%d %s %s %s", p->pid, state, p->sclass->name, p->name);
     if(p->state == SLEEPING){
       getcallerpcs((uint*)p->context->ebp+2, pc);
       for(i=0; i<10 && pc[i] != 0; i++)
@@ -880,45 +1311,83 @@ procdump(void)
     }
     cprintf("\n");
   }
+  for(i = 0; i < ncpu; i++)
+    cprintf("cpu%d queued %d steal %d migrate %d handoff %d "
+            "idle %d times %d ticks\n",
+            i, cpus[i].rq.nproc, cpus[i].nsteal, cpus[i].nmigrate,
+            cpus[i].nhandoff, cpus[i].nidle, cpus[i].idleticks);
 }
 
-void
-mlfq_yield(void)
+// Copy the scheduler statistics of cpu n to st.
+int
+getcpustat(int n, struct cpustat *st)
 {
-  struct proc* p = myproc();
-#if DEBUG
-    cprintf("mlfq called\n");
-#endif
-  if (p->u2.tick < ticklimit(p->u1.priority)) {
-    p->u2.tick++;
-    p->u3.runticks++;
-    ptable.mlfq.tick++;
+  struct cpu *c;
 
-#if DEBUG
-    cprintf("mlfq call %d\n", myproc()->u1.priority);
-#endif
-    check_down_priority(p);
-  } else {
-    p->u2.tick = 0;
-#if DEBUG
-    cprintf("YIELD\n");
-#endif
-    yield();
-  }
+  if (n < 0 || n >= ncpu)
+    return -1;
+  c = &cpus[n];
+  acquire(&ptable.lock);
+  st->nsteal = c->nsteal;
+  st->nmigrate = c->nmigrate;
+  st->nqueued = c->rq.nproc;
+  st->nidle = c->nidle;
+  st->idleticks = c->idleticks;
+  st->nhandoff = c->nhandoff;
+  st->ngang = c->ngang;
+  st->ninherit = c->ninherit;
+  release(&ptable.lock);
+  return 0;
 }
 
-void
-stride_yield(void)
+// Copy the mlfq tunables to mp.
+int
+getmlfqparam(struct mlfqparam *mp)
 {
-  yield();
+  acquire(&ptable.lock);
+  mlfq_getparam(mp);
+  release(&ptable.lock);
+  return 0;
+}
+
+// Replace the mlfq tunables with mp, all at once.
+int
+setmlfqparam(struct mlfqparam *mp)
+{
+  int r;
+
+  acquire(&ptable.lock);
+  r = mlfq_setparam(mp);
+  release(&ptable.lock);
+  return r;
+}
+
+// Keep percent of the cpu for the mlfq class at least, letting
+// stride and edf processes reserve the rest. Returns the old
+// floor, or -1 if percent is not within 1 to 100 or more than
+// that is reserved already.
+int
+set_mlfq_floor(int percent)
+{
+  int r;
+
+  if (percent < 1 || percent > 100)
+    return -1;
+  r = stride_setlimit(MAXTICKETS - percent * 10);
+  if (r < 0)
+    return -1;
+  return (MAXTICKETS - r) / 10;
 }
 
 int
 getlev(void)
 {
-  return myproc()->u1.priority;
+  return myproc()->mlfq.priority;
 }
 
+// Split the tickets of a thread group evenly among the threads
+// that have not exited. Threads in the edf class keep their own
+// reservation and are left out. Caller holds ptable.lock.
 void
 share_tickets(struct proc *mthread)
 {
@@ -926,33 +1395,25 @@ share_tickets(struct proc *mthread)
   int cnt = 0;
   for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
   {
-    if (p->main_thread == mthread)
+    if (p->main_thread == mthread && p->sclass != &edf_class
+        && p->state != UNUSED && p->state != ZOMBIE)
     {
       cnt++;
     }
   }
 
-  if (cnt == 0) panic("share_tickets panic\n");
+  if (cnt == 0) return;
   cnt = mthread->alltickets / cnt;
   if (cnt == 0) cnt = 1;
   
   for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
   {
-    if (p->main_thread == mthread)
+    if (p->main_thread == mthread && p->sclass != &edf_class
+        && p->state != UNUSED && p->state != ZOMBIE)
     {
-      p->u2.tickets = cnt;
-      p->u3.stride = STRIDE / cnt;
-      if (p->type == 'm')
-      {
-        // new process
-        p->type = 's';
-        p->u1.passvalue = mthread->u1.passvalue;
-        push(p);
-      }
+      stride_settickets(p, cnt);
     }
   }
-  
-  // mthread->u3.stride = STRIDE / mthread->u2.tickets;
 }
 
 int
@@ -960,48 +1421,50 @@ set_cpu_share(int tickets)
 {
   if (tickets == 0) return -1;
   struct proc* p = myproc();
+  struct proc* mthread = p->main_thread;
   int saved = tickets;
   tickets = tickets * 10;
-  if (p->type == 'm') {
-    if (ptable.stride.total_tickets + tickets > LIMITTICKETS) return -1;
-    
-    acquire(&ptable.lock);
-    ptable.stride.total_tickets += tickets;
-    p->u2.tickets = tickets;
-    p->main_thread->alltickets = tickets;
-
-    if (ptable.stride.cntproc == 0) {
-      p->u1.passvalue = ptable.mlfq.passvalue;
-    } else {
-      p->u1.passvalue = ptable.stride.p[1]->u1.passvalue;
-    }
-
-    share_tickets(p->main_thread);
-    // p->type = 's';
-    // push(p);
-  } else {
-    int future_tickets = ptable.stride.total_tickets + tickets - p->u2.tickets;
-    if (future_tickets > LIMITTICKETS) return -1;
-    
-    acquire(&ptable.lock);
-    ptable.stride.total_tickets = future_tickets;
-    p->u2.tick = tickets;
 
-    p->main_thread->alltickets = tickets;
-    share_tickets(p->main_thread);
+  acquire(&ptable.lock);
+  if (stride_reserve(mthread->alltickets, tickets) < 0) {
+    release(&ptable.lock);
+    return -1;
   }
+  mthread->alltickets = tickets;
+  share_tickets(mthread);
   release(&ptable.lock);
   return saved;
 }
 
+// Put the current process in the edf class, to get runtime ticks
+// of cpu before a deadline every period ticks.
+// set_deadline(0, 0) returns it to the mlfq class.
+int
+set_deadline(int runtime, int period)
+{
+  struct proc *p = myproc();
+  int r = 0;
+
+  acquire(&ptable.lock);
+  if (runtime == 0 && period == 0) {
+    if (p->sclass == &edf_class)
+      setclass(p, &mlfq_class);
+  } else {
+    r = edf_admit(p, runtime, period);
+  }
+  release(&ptable.lock);
+  return r;
+}
+
 int
 thread_create(thread_t *thread, void *(*start_routine)(void *), void *arg)
 {
   struct proc *np;
   struct proc *curproc = myproc();
   struct proc *mthread = curproc->main_thread;
+  struct mm *mm = curproc->mm;
   
-  while((__sync_val_compare_and_swap(&mthread->cguard, 0, 1)) == 1);
+  mmlock(mm);
   // ptable has full process
   if ((np = allocproc()) == 0)
   {
@@ -1009,15 +1472,14 @@ thread_create(thread_t *thread, void *(*start_routine)(void *), void *arg)
     return -1;
   }
 
-  // Set Parent
   np->main_thread = mthread;
-  np->parent = mthread->parent;
+  np->affinity = curproc->affinity;
   *thread = np->pid;
 
-  if (mthread->type == 's')
-  {
+  acquire(&ptable.lock);
+  if (mthread->alltickets)
     share_tickets(mthread);
-  }
+  release(&ptable.lock);
 
   // Copy File Descriptor
   int i;
@@ -1028,20 +1490,25 @@ thread_create(thread_t *thread, void *(*start_routine)(void *), void *arg)
       np->ofile[i] = filedup(curproc->ofile[i]);
     }
   }
-  np->cwd = idup(mthread->cwd);
-  safestrcpy(np->name, mthread->name, sizeof(mthread->name));
+  np->cwd = idup(curproc->cwd);
+  safestrcpy(np->name, curproc->name, sizeof(curproc->name));
 
-  // Alloc Thread at Main Thread
+  // Alloc Thread in the mm
   int tid = 0;
-  for (i = 1; i < NPROC; i++)
+  acquire(&wait_lock);
+  // The main thread keeps our parent, even after it exits.
+  np->parent = mthread->parent;
+  for (i = 1; i < NTHREAD; i++)
   {
-    if (!mthread->hasThread[i])
+    if (!mm->thread[i])
     {
       tid = i;
-      mthread->hasThread[i] = 1;
+      mm->thread[i] = np;
+      mm->nthread++;
       break;
     }
   }
+  release(&wait_lock);
 
   if (tid == 0)
   {
@@ -1055,16 +1522,15 @@ thread_create(thread_t *thread, void *(*start_routine)(void *), void *arg)
  
   uint sz, ustack[2];
   pde_t *pgdir;
-  pgdir = mthread->pgdir;
+  pgdir = mm->pgdir;
 
 
 
-  sz = mthread->stack - ( (tid - 1) * PGSIZE);
-  if (tid > mthread->maxtid) {
-    mthread->maxtid = tid;
+  sz = mm->stack - ( (tid - 1) * PGSIZE);
+  if (tid > mm->maxtid) {
+    mm->maxtid = tid;
     // alloc
     sz -= PGSIZE;
-    np->stack = sz;
     if ((sz = allocuvm(pgdir, sz, sz + PGSIZE)) == 0)
     {
       panic("alloc uvm at thread create fail");
@@ -1084,112 +1550,326 @@ thread_create(thread_t *thread, void *(*start_routine)(void *), void *arg)
   np->tf->eax = 0;
   *np->tf = *curproc->tf;
   np->pgdir = pgdir;
-  np->sz = mthread->sz;
-  np->heap = mthread->heap;
+  np->mm = mmdup(mm);
   np->tf->eip = (uint)start_routine;
   np->tf->esp = sz;
   // Change Process State
   acquire(&ptable.lock);
-  np->state = RUNNABLE;
-  __sync_fetch_and_sub(&mthread->cguard, 1);
+  makerunnable(np, 0);
+  kickidle(np);
   release(&ptable.lock);
+  mmunlock(mm);
   return 0;
 }
 
+// Find the thread with the given pid in the thread table of mm.
+// Thread ids handed to users are pids, not tids, so this walks
+// the table up to the highest tid handed out: it costs O(maxtid),
+// not O(1), but never scans ptable. Caller holds wait_lock.
+static struct proc*
+findthread(struct mm *mm, int pid)
+{
+  struct proc *p;
+  int tid;
+
+  for (tid = 1; tid <= mm->maxtid; tid++) {
+    p = mm->thread[tid];
+    if (p && p->pid == pid)
+      return p;
+  }
+  return 0;
+}
+
+// Free the exited thread p: take it out of its group and out of
+// the reach of wait(), then tear it down. Caller holds wait_lock,
+// which reapthread releases.
+static void
+reapthread(struct proc *p)
+{
+  p->mm->thread[p->tid] = 0;
+  p->pgdir = 0;
+  p->parent = 0;
+  release(&wait_lock);
+
+  // Once we have held ptable.lock, p is off its cpu and
+  // no longer uses its kernel stack.
+  acquire(&ptable.lock);
+  release(&ptable.lock);
+  exitproc(p);
+  kfree(p->kstack);
+  p->kstack = 0;
+  setunused(p);
+}
+
+// Wait for the thread to exit and reap it. Joiners sleep on the
+// thread's own &p->tid, so only its exit wakes them.
 int
 thread_join(thread_t thread, void **retval)
 {
   struct proc *p;
   struct proc *curproc = myproc();
-  acquire(&ptable.lock);
-  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-  {
-    if (p->pid == thread)
-    {
-      while (1)
-      {
-        if (p->state == ZOMBIE)
-        {
-
-          *retval = (void*)p->maxtid;
-          exitproc(p);
-          kfree(p->kstack);
-          release(&ptable.lock);
-          return 0;
-        } else {
-          sleep(curproc, &ptable.lock);
-        }
+  struct mm *mm = curproc->mm;
+  int tid;
+
+  acquire(&wait_lock);
+  p = findthread(mm, thread);
+  if (p == 0 || p == curproc || p->detached) {
+    release(&wait_lock);
+    return -1;
+  }
+  tid = p->tid;
+  while (p->state != ZOMBIE) {
+    sleep(&p->tid, &wait_lock);
+    // Someone else may have joined or detached it meanwhile.
+    if (mm->thread[tid] != p || p->detached || curproc->killed) {
+      release(&wait_lock);
+      return -1;
+    }
+  }
+  *retval = p->retval;
+  reapthread(p);
+  return 0;
+}
+
+// Wait for any joinable thread of our group to exit and reap it.
+// Joiners of any thread sleep on mm->thread.
+// Returns -1 if there is no thread to wait for.
+int
+thread_join_any(thread_t *thread, void **retval)
+{
+  struct proc *p;
+  struct proc *curproc = myproc();
+  struct mm *mm = curproc->mm;
+  int tid, havethreads;
+
+  acquire(&wait_lock);
+  for (;;) {
+    havethreads = 0;
+    for (tid = 1; tid <= mm->maxtid; tid++) {
+      p = mm->thread[tid];
+      if (p == 0 || p == curproc || p->detached)
+        continue;
+      havethreads = 1;
+      if (p->state == ZOMBIE) {
+        *thread = p->pid;
+        *retval = p->retval;
+        reapthread(p);
+        return 0;
       }
     }
+    if (!havethreads || curproc->killed) {
+      release(&wait_lock);
+      return -1;
+    }
+    sleep(mm->thread, &wait_lock);
+  }
+}
+
+// Let the thread be reaped as soon as it exits, without a joiner.
+// It can no longer be joined.
+int
+thread_detach(thread_t thread)
+{
+  struct proc *p;
+  struct proc *curproc = myproc();
+
+  acquire(&wait_lock);
+  p = findthread(curproc->mm, thread);
+  if (p == 0 || p->detached) {
+    release(&wait_lock);
+    return -1;
+  }
+  if (p->state == ZOMBIE) {
+    reapthread(p);
+    return 0;
   }
+  p->detached = 1;
+  // Joiners of p give up.
+  acquire(&ptable.lock);
+  wakeup1(&p->tid);
   release(&ptable.lock);
-  return -1;
+  release(&wait_lock);
+  return 0;
 }
 
-void thread_exit(void *retval)
+// Exit the current thread. The main thread may exit before the
+// others, which keep running; the last thread to exit ends the
+// process.
+void
+thread_exit(void *retval)
 {
   struct proc *curproc = myproc();
-  if (curproc->main_thread == curproc)
+  struct proc *mthread = curproc->main_thread;
+  struct mm *mm = curproc->mm;
+  struct proc *p;
+  int fd;
+
+  acquire(&wait_lock);
+  if (mm->nthread == 1)
   {
+    release(&wait_lock);
     exit();
   }
+  mm->nthread--;
+  release(&wait_lock);
 
-  curproc->maxtid = (int)retval;
+  // Drop our files here, where we may sleep; whoever reaps us
+  // holds spinlocks.
+  for (fd = 0; fd < NOFILE; fd++)
+  {
+    if (curproc->ofile[fd])
+    {
+      fileclose(curproc->ofile[fd]);
+      curproc->ofile[fd] = 0;
+    }
+  }
+  begin_op();
+  iput(curproc->cwd);
+  end_op();
+  curproc->cwd = 0;
+
+  curproc->retval = retval;
+  acquire(&wait_lock);
   acquire(&ptable.lock);
-  
-  if (curproc->type == 's') {
-    pop_proc(curproc);
-    share_tickets(curproc->main_thread);
+
+  // Pass our children to init, as exit() does; our slot may be
+  // reused once we are reaped.
+  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++) {
+    if (p->parent == curproc) {
+      p->parent = initproc;
+      if (p->state == ZOMBIE)
+        wakeup1(initproc);
+    }
   }
-  wakeup1(curproc->main_thread); 
+
+  // Become a zombie first so the re-share counts only the
+  // threads that stay behind.
   curproc->state = ZOMBIE;
-  //printallstate();
+  if (mthread->alltickets) {
+    share_tickets(mthread);
+  }
+  leaveclass(curproc);
+  if (curproc->detached) {
+    // Leave the group now. allocproc() takes our slot, kernel
+    // stack and reference to the mm once we are off the cpu.
+    mm->thread[curproc->tid] = 0;
+    curproc->pgdir = 0;
+    curproc->parent = 0;
+  } else {
+    wakeup1(&curproc->tid);
+    wakeup1(mm->thread);
+  }
+  release(&wait_lock);
   
   sched();
   panic("thread exit error with zombie");
 }
 
-void deallocthread(struct proc* mthread, int pid)
+void
+deallocthread(struct proc *mthread, int pid)
 {
-  while((__sync_val_compare_and_swap(&mthread->cguard, 0, 1)) == 1);
-  
-  struct proc *p; 
-  pde_t *pgdir = mthread->pgdir;
+  struct mm *mm = mthread->mm;
 
+  mmlock(mm);
+  struct proc *p, *dead[NPROC];
+  pde_t *pgdir = mthread->pgdir;
+  int i, n = 0, running;
+
+  // Take our siblings out of the scheduler, the thread table and
+  // the reach of wait() and joiners all at once, then take them
+  // apart. A sibling still running on another cpu is killed and
+  // we wait for it to leave its cpu first, so that nothing is
+  // taken apart under it. Detached threads that have exited are
+  // not ours any more; allocproc() reuses them.
+  for (;;)
+  {
+    acquire(&wait_lock);
+    acquire(&ptable.lock);
+    running = 0;
+    for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    {
+      if (p->pgdir == pgdir && p->pid != pid && p->state == RUNNING) {
+        p->killed = 1;
+        running = 1;
+      }
+    }
+    if (!running)
+      break;
+    release(&ptable.lock);
+    release(&wait_lock);
+    yield();
+  }
   for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
   {
-    if (p->pgdir == pgdir && p->pid != pid && p->state != UNUSED)
-    { 
+    if (p->pgdir != pgdir || p->pid == pid || p->state == UNUSED)
+      continue;
+    if (p->state == SLEEPING)
+      wqremove(p);
+    else if (p->state != ZOMBIE)
+      dequeue(p);
+    if (p->state != ZOMBIE)
+      leaveclass(p);
+    p->state = ZOMBIE;
+    p->parent = 0;
+    p->pgdir = 0;
+    dead[n++] = p;
+  }
+  // We are the only thread left, and the main one now. The
+  // group's stride reservation passes to us with the rest.
+  if (mthread->main_thread != mthread) {
+    mthread->alltickets = mthread->main_thread->alltickets;
+    mthread->main_thread->alltickets = 0;
+    mthread->main_thread = mthread;
+    mthread->tid = 0;
+  }
+  if (mthread->alltickets)
+    share_tickets(mthread);
+  // Pass the children of our siblings to init.
+  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    for (i = 0; i < n; i++)
+      if (p->parent == dead[i]) {
+        p->parent = initproc;
+        if (p->state == ZOMBIE)
+          wakeup1(initproc);
+      }
+  release(&ptable.lock);
+  memset(mm->thread, 0, sizeof(mm->thread));
+  mm->nthread = 1;
+  release(&wait_lock);
+
+  for (i = 0; i < n; i++)
+  {
+    p = dead[i];
+    futexdrop(p);
+    if (p->cwd) {
       begin_op();
       iput(p->cwd);
       end_op();
       p->cwd = 0;
-      exitproc(p);
     }
+    exitproc(p);
+    kfree(p->kstack);
+    p->kstack = 0;
+    setunused(p);
   }
-
-  //cprintf("%d dealloc\n", pid);
-  //printallstate();
-/*
-  int stack = mthread->stack;
-  uint sz = KERNBASE - 3 * PGSIZE;
-  uint min = stack - (mthread->maxtid * PGSIZE);
-  mthread->maxtid = 0;
-  if ((sz = deallocuvm(mthread->pgdir, min, sz))== 0)
-  {
-    panic("dealloc uvm err");
-  }
-**/
-  __sync_fetch_and_sub(&mthread->cguard, 1);
+  mmunlock(mm);
 }
 
-void exitproc(struct proc *p)
-{ 
-  p->state = UNUSED;
-  if (p->type == 's') {
-    pop_proc(p);
-  }
+// Free the thread p, which its caller has taken out of its group.
+// The caller frees its kernel stack and marks it UNUSED afterwards.
+static void
+exitproc(struct proc *p)
+{
   int fd;
+
+  // A thread taken down in sys_sleep() leaves its timer on the
+  // wheel; the timer is on the kernel stack about to be freed.
+  acquire(&tickslock);
+  if (p->timer) {
+    timerdel(p->timer);
+    p->timer = 0;
+  }
+  release(&tickslock);
   for (fd = 0; fd < NOFILE; fd++)
   {
     if (p->ofile[fd])
@@ -1198,13 +1878,11 @@ void exitproc(struct proc *p)
       p->ofile[fd] = 0;
     }
   }
-  p->main_thread->hasThread[p->tid] = 0;
   p->tid = 0;
-  p->heap = 0;
-  p->stack = 0; 
-  p->maxtid = 0;
+  if (p->mm)
+    mmput(p->mm);
+  p->mm = 0;
   p->pgdir = 0;
-  p->eguard = 1;
   p->main_thread = 0;
 }
 
@@ -1,3 +1,13 @@
+// Per-CPU MLFQ run queue: one FIFO per priority level.
+// Bit i of bitmap is set iff level i is non-empty.
+struct runq {
+  struct proc *head[NLEVEL];   // next process to run at each level
+  struct proc *tail[NLEVEL];   // last process queued at each level
+  uint bitmap;                 // non-empty levels
+  int nproc;                   // number of queued processes
+  uint agetick;                // ticks when last aged
+};
+
 // Per-CPU state
 struct cpu {
   uchar apicid;                // Local APIC ID
@@ -8,6 +18,18 @@ struct cpu {
   int ncli;                    // Depth of pushcli nesting.
   int intena;                  // Were interrupts enabled before pushcli?
   struct proc *proc;           // The process running on this cpu or null
+  struct runq rq;              // RUNNABLE mlfq processes queued here
+  uint nsteal;                 // processes stolen from other cpus
+  uint nmigrate;               // processes that last ran on another cpu
+  volatile int idle;           // halted with nothing to run
+  uint nidle;                  // times this cpu went idle
+  uint idleticks;              // ticks spent idle
+  uint nhandoff;               // direct switches between threads
+  struct proc *gang;           // main thread of a gang to run next
+  uint ngang;                  // threads run to join their gang
+  uint ninherit;               // priorities lent to sleeplock holders
+  volatile int resched;        // preempt the running process
+  int intr;                    // in an interrupt handler
 };
 
 extern struct cpu cpus[NCPU];
@@ -34,10 +56,48 @@ struct context {
 
 enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
+// Per-process state of the mlfq scheduling class (mlfq.c).
+struct mlfqent {
+  int priority;                // cur process priority
+  int tick;                    // cur process tick
+  int runticks;                // cur process runticks
+  int boostgen;                // boost generation when queued
+  uint enqtick;                // ticks when queued at its level
+  uint gservice;               // ticks run by our thread group
+                               //  (kept in the main thread)
+  struct proc *next;           // next in run queue
+  struct proc *prev;           // previous in run queue
+  struct cpu *rqcpu;           // run queue holding us or null
+  int ilevel;                  // level lent by a sleeplock waiter,
+                               //  or NLEVEL
+};
+
+// Per-process state of the stride scheduling class (stride.c).
+struct strideent {
+  uint64 passvalue;            // cur process passvalue
+  int tickets;                 // cur process tickets
+  uint stride;                 // cur process stride, see pass.h
+  int hidx;                    // index in stride heap or 0
+  uint64 lent;                 // pass taken off for a sleeplock waiter
+};
+
+// Per-process state of the edf scheduling class (edf.c).
+struct edfent {
+  int runtime;                 // budget per period (ticks)
+  int period;                  // relative deadline (ticks)
+  int tickets;                 // reserved capacity
+  uint deadline;               // absolute deadline (ticks)
+  int budget;                  // ticks left before deadline
+  int throttled;               // budget used up; wait for deadline
+  struct proc *next;           // next on ready or throttled list
+  struct proc *prev;           // previous on that list
+  int onq;                     // EDF_READY, EDF_THROTTLED or 0
+};
+
 // Per-process state
 struct proc {
-  uint sz;                     // Size of process memory (bytes)
-  pde_t* pgdir;                // Page table
+  pde_t* pgdir;                // Page table, mm->pgdir
+  struct mm *mm;               // Address space, shared by our threads
   char *kstack;                // Bottom of kernel stack for this process
   enum procstate state;        // Process state
   int pid;                     // Process ID
@@ -49,45 +109,33 @@ struct proc {
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
-  char type;                   // default 'm' mlfq / call cpu share 's' stride
-  union {
-    int priority;              // [mlfq]   cur process priority
-    int passvalue;             // [stride] cur process passvalue
-  } u1;
-  union {
-    int tick;                  // [mlfq]   cur process tick
-    int tickets;               // [stride] cur process tickets
-  } u2;
-  union {
-    int runticks;              // [mlfq]   cur process runticks
-    int stride;                // [stride] cur process stride
-  } u3;
+  struct sched_class *sclass;  // [sched]  scheduling class (sched.h)
+  struct mlfqent mlfq;         // [mlfq]   mlfq class state
+  struct strideent stride;     // [stride] stride class state
+  struct edfent edf;           // [edf]    edf class state
   int tid;                     // [thread] thread id / init : -1
-  int heap;                    // [thread] top of heap (main thread)
-  int stack;                   // [thread] per process base_stack
-  int hasThread[64];           // [thread] find empty stack space;
-  struct proc *main_thread;    // [thread] main thread parent
-  int maxtid;                  // [thread] stack max low;
+  struct proc *main_thread;    // [thread] main thread, heads our thread group
+  void *retval;                // [thread] value passed to thread_exit()
   int alltickets;              // [thread] all thread's ticket saved a tmainthread
   int guard;                   // [thread] exit guard
-  int cguard;                  // [thread] thread_create guard
   int eguard;                  // [thread] check exit or threadexit
+  int gang;                    // [thread] co-schedule our threads (main thread)
+  int detached;                // [thread] nobody joins us, reaped at exit
+  struct cpu *cpu;             // [sched]  cpu we last ran on
+  uint lastrun;                // [sched]  ticks when we last left a cpu
+  struct proc *wqnext;         // [sched]  next on wait queue of chan
+  struct proc *wqprev;         // [sched]  previous on wait queue of chan
+  struct proc *handoff;        // [sched]  sibling we woke last
+  int handoffpid;              // [sched]  its pid when we woke it
+  uint affinity;               // [sched]  cpus we may run on, bit per cpu
+  int nsleeplock;              // [sched]  sleeplocks we hold
+  int inherited;               // [sched]  runs with a waiter's priority
+  pde_t *fpgdir;               // [futex]  address space of faddr
+  uint faddr;                  // [futex]  user word we wait on, 0 if none
+  struct proc *fnext;          // [futex]  next waiter in the futex bucket
+  struct timer *timer;         // [sleep]  armed sys_sleep() timer, on kstack
 };
 
-struct mlfq {
-  int priority;                // priority of mlfq queue
-  int passvalue;               // cur location (compare stride passvalue)
-  int index;                   // index using round robin
-  int tick;                    // mlfq tick for boost
-};
-
-struct pqstride {
-  struct proc* p[NPROC + 1];   // process priority queue
-  int cntproc;                 // count stride nodes
-  int total_tickets;           // stride total tickets <= 80
-};
-
-void deallocthread(struct proc* p, int pid);
 // Process memory is laid out contiguously, low addresses first:
 //   text
 //   original data and bss
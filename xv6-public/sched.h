@@ -0,0 +1,69 @@
+// Scheduling classes.
+//
+// Every process belongs to one scheduling class, p->sclass, which
+// owns the run queue of its RUNNABLE processes. scheduler() asks
+// the classes in sched_classes[] order for the next process to run,
+// so an earlier class has precedence over a later one.
+//
+// All hooks but tick and clockdue are called with ptable.lock
+// held. tick is called by the timer interrupt without it, and may
+// only update the running process and counters of the class.
+// Hooks after nrunnable are optional and may be null.
+struct sched_class {
+  char *name;
+
+  // p joins the class; set up its class state.
+  void (*init)(struct proc *p);
+
+  // p became RUNNABLE; queue it. flags is a set of ENQ_ bits.
+  void (*enqueue)(struct proc *p, int flags);
+
+  // Take the RUNNABLE p off its queue, if it is queued.
+  void (*dequeue)(struct proc *p);
+
+  // Dequeue and charge the process cpu c should run next, or 0.
+  struct proc* (*pick_next)(struct cpu *c);
+
+  // Timer tick while p runs. Returns 1 if p should yield.
+  int (*tick)(struct proc *p);
+
+  // p gives up its cpu, voluntarily or at the end of its slice.
+  void (*yield)(struct proc *p);
+
+  // Number of processes queued that cpu c may pick.
+  int (*nrunnable)(struct cpu *c);
+
+  // p was dequeued to run without pick_next (a gang pick in
+  // scheduler()); charge it what pick_next would have.
+  void (*charge)(struct proc *p);
+
+  // p is leaving the class; drop what it holds there.
+  void (*leave)(struct proc *p);
+
+  // p, not queued, holds a sleeplock that from waits for. Let p
+  // run at least as urgently as from; returns 1 if that raised p.
+  // restore undoes what inherit lent p.
+  int (*inherit)(struct proc *p, struct proc *from);
+  void (*restore)(struct proc *p);
+
+  // Called on cpu 0 every tick without ptable.lock; returns 1 if
+  // the class has timed work due, which clock then does.
+  int (*clockdue)(void);
+  void (*clock)(void);
+};
+
+#define ENQ_WAKEUP  0x1   // p was SLEEPING
+
+// May process p run on cpu c? See sched_setaffinity().
+#define cpuallowed(p, c)  (((p)->affinity >> ((c) - cpus)) & 1)
+
+// Cpu capacity is accounted in tickets: MAXTICKETS is one cpu.
+// The stride and edf classes together may reserve LIMITTICKETS,
+// unless set_mlfq_floor() changed that.
+#define LIMITTICKETS  800
+#define MAXTICKETS    1000
+
+extern struct sched_class edf_class;
+extern struct sched_class mlfq_class;
+extern struct sched_class stride_class;
+extern struct sched_class *sched_classes[];
@@ -0,0 +1,358 @@
+/**
+ *  Scheduler benchmark. Runs a mix of workers pinned to one cpu for
+ * a number of ticks while draining the scheduler trace (schedtrace())
+ * and reports:
+ *  - the share of the cpu's busy time each worker got, against the
+ *    share it asked for (stride tickets, or an even split of what is
+ *    left for the mlfq cpu-bound workers),
+ *  - wakeup-to-run latency percentiles per kind of worker,
+ *  - context switches per second on the cpu.
+ *
+ *  usage: schedbench [-t ticks] [-c cpu] [spec ...]
+ *  where spec is one of
+ *    cpu:N         N cpu-bound mlfq workers
+ *    io:N          N workers writing small files
+ *    int:N         N interactive workers, sleeping a tick between bursts
+ *    stride:N:P    N cpu-bound workers with set_cpu_share(P)
+ *  The default mix is cpu:2 io:1 int:2 stride:1:20 stride:1:10.
+ *
+ *  Every output line is a record name followed by key=value fields.
+ * Shares are per mille, times and latencies are tsc cycles.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "schedtrace.h"
+
+#define NCPU_MAX        8
+#define NWORKER         16
+#define NSAMPLE         2048        // latency samples kept per kind
+#define HZ              100         // timer ticks per second
+#define BURST           20000       // (iteration) of an interactive burst
+#define SHIFT           8           // runtimes are kept in 256 cycles
+
+#define CPU             0
+#define IO              1
+#define INT             2
+#define STRIDE          3
+#define NKIND           4
+
+char *kindname[] = { "cpu", "io", "int", "stride" };
+
+struct worker {
+  int kind;
+  int pct;                          // set_cpu_share() of a stride worker
+  int pid;
+  uint run;                         // runtime on the bench cpu
+  uint nwakeup;
+} w[NWORKER];
+int nworker;
+
+struct schedev ev[NCPU_MAX][NTRACE];
+int nev[NCPU_MAX];
+
+// Per cpu: who runs there since when.
+int curpid[NCPU_MAX];
+uint curtsc[NCPU_MAX];
+
+uint lat[NKIND][NSAMPLE];
+int nlat[NKIND];
+uint wakets[NWORKER];               // tsc of a pending wakeup, or 0
+
+int benchcpu;
+uint busy;                          // runtime of anything on benchcpu
+uint nswitch;
+uint lost;
+
+void
+spin(int n)
+{
+  volatile int i;
+
+  for (i = 0; i < n; i++)
+    ;
+}
+
+void
+cpuworker(void)
+{
+  for (;;)
+    spin(BURST);
+}
+
+void
+intworker(void)
+{
+  for (;;) {
+    sleep(1);
+    spin(BURST);
+  }
+}
+
+void
+ioworker(int id)
+{
+  char name[8], buf[512];
+  int fd, i;
+
+  strcpy(name, "sbio?");
+  name[4] = 'a' + id;
+  memset(buf, id, sizeof(buf));
+  for (;;) {
+    if ((fd = open(name, O_CREATE | O_RDWR)) < 0)
+      exit();
+    for (i = 0; i < 16; i++)
+      write(fd, buf, sizeof(buf));
+    close(fd);
+    unlink(name);
+  }
+}
+
+int
+findworker(int pid)
+{
+  int i;
+
+  for (i = 0; i < nworker; i++)
+    if (w[i].pid == pid)
+      return i;
+  return -1;
+}
+
+void
+account(struct schedev *e)
+{
+  int i = findworker(e->pid);
+  int c = e->cpu;
+  uint d;
+
+  switch (e->type) {
+  case SEV_WAKEUP:
+    if (i >= 0)
+      wakets[i] = e->tsc;
+    break;
+  case SEV_SWITCHIN:
+    curpid[c] = e->pid;
+    curtsc[c] = e->tsc;
+    if (c == benchcpu)
+      nswitch++;
+    if (i >= 0 && wakets[i]) {
+      w[i].nwakeup++;
+      if (nlat[w[i].kind] < NSAMPLE)
+        lat[w[i].kind][nlat[w[i].kind]++] = e->tsc - wakets[i];
+      wakets[i] = 0;
+    }
+    break;
+  case SEV_SWITCHOUT:
+    if (curpid[c] != e->pid)
+      break;
+    curpid[c] = -1;
+    if (c != benchcpu)
+      break;
+    d = (e->tsc - curtsc[c]) >> SHIFT;
+    busy += d;
+    if (i >= 0)
+      w[i].run += d;
+    break;
+  case SEV_LOST:
+    lost += e->arg;
+    curpid[c] = -1;
+    memset(wakets, 0, sizeof(wakets));
+    break;
+  }
+}
+
+// Drain every cpu's ring and account the events in time order.
+void
+drain(int doaccount)
+{
+  int pos[NCPU_MAX];
+  int ncpu, i, best;
+
+  for (ncpu = 0; ncpu < NCPU_MAX; ncpu++) {
+    if ((nev[ncpu] = schedtrace(ncpu, ev[ncpu], NTRACE)) < 0)
+      break;
+    pos[ncpu] = 0;
+  }
+  if (!doaccount)
+    return;
+  for (;;) {
+    best = -1;
+    for (i = 0; i < ncpu; i++) {
+      if (pos[i] == nev[i])
+        continue;
+      if (best < 0
+          || (int)(ev[i][pos[i]].tsc - ev[best][pos[best]].tsc) < 0)
+        best = i;
+    }
+    if (best < 0)
+      return;
+    account(&ev[best][pos[best]++]);
+  }
+}
+
+void
+sort(uint *a, int n)
+{
+  int gap, i, j;
+  uint x;
+
+  for (gap = n / 2; gap > 0; gap /= 2)
+    for (i = gap; i < n; i++) {
+      x = a[i];
+      for (j = i; j >= gap && a[j - gap] > x; j -= gap)
+        a[j] = a[j - gap];
+      a[j] = x;
+    }
+}
+
+// x * 1000 / total without overflowing.
+uint
+permille(uint x, uint total)
+{
+  if (total < 1000)
+    return 0;
+  return x / (total / 1000);
+}
+
+// Parse "kind:N[:P]" into the worker table.
+int
+parse(char *s)
+{
+  char *p;
+  int kind, n, pct = 0;
+
+  if ((p = strchr(s, ':')) == 0)
+    return -1;
+  *p++ = 0;
+  for (kind = 0; kind < NKIND; kind++)
+    if (strcmp(s, kindname[kind]) == 0)
+      break;
+  if (kind == NKIND || (n = atoi(p)) <= 0)
+    return -1;
+  if (kind == STRIDE) {
+    if ((p = strchr(p, ':')) == 0 || (pct = atoi(p + 1)) <= 0)
+      return -1;
+  }
+  while (n-- > 0) {
+    if (nworker == NWORKER)
+      return -1;
+    w[nworker].kind = kind;
+    w[nworker].pct = pct;
+    nworker++;
+  }
+  return 0;
+}
+
+void
+start(int id)
+{
+  struct worker *wk = &w[id];
+
+  if ((wk->pid = fork()) != 0)
+    return;
+  sched_setaffinity(0, 1 << benchcpu);
+  if (wk->kind == STRIDE && set_cpu_share(wk->pct) < 0) {
+    printf(2, "schedbench: cannot set cpu share %d\n", wk->pct);
+    exit();
+  }
+  switch (wk->kind) {
+  case CPU:
+  case STRIDE:
+    cpuworker();
+  case IO:
+    ioworker(id);
+  case INT:
+    intworker();
+  }
+  exit();
+}
+
+void
+report(int ticks, int ncpu)
+{
+  int i, k, n, ncpuw = 0, left = 1000, want;
+
+  for (i = 0; i < nworker; i++) {
+    if (w[i].kind == STRIDE)
+      left -= w[i].pct * 10;
+    else if (w[i].kind == CPU)
+      ncpuw++;
+  }
+  printf(1, "schedbench ticks=%d hz=%d cpu=%d ncpu=%d workers=%d lost=%d\n",
+         ticks, HZ, benchcpu, ncpu, nworker, lost);
+  for (i = 0; i < nworker; i++) {
+    if (w[i].kind == STRIDE)
+      want = w[i].pct * 10;
+    else if (w[i].kind == CPU && left > 0)
+      want = left / ncpuw;
+    else
+      want = -1;
+    printf(1, "worker id=%d pid=%d kind=%s want=%d share=%d wakeups=%d\n",
+           i, w[i].pid, kindname[w[i].kind], want,
+           permille(w[i].run, busy), w[i].nwakeup);
+  }
+  for (k = 0; k < NKIND; k++) {
+    if ((n = nlat[k]) == 0)
+      continue;
+    sort(lat[k], n);
+    printf(1, "latency kind=%s n=%d p50=%d p90=%d p99=%d max=%d\n",
+           kindname[k], n, lat[k][(n - 1) * 50 / 100],
+           lat[k][(n - 1) * 90 / 100], lat[k][(n - 1) * 99 / 100],
+           lat[k][n - 1]);
+  }
+  printf(1, "switches cpu=%d n=%d per_sec=%d\n",
+         benchcpu, nswitch, nswitch * HZ / ticks);
+}
+
+int
+main(int argc, char *argv[])
+{
+  char *defmix[] = { "cpu:2", "io:1", "int:2", "stride:1:20", "stride:1:10" };
+  char spec[32];
+  int i, t, ticks = 200, ncpu;
+
+  for (i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+      ticks = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+      benchcpu = atoi(argv[++i]);
+    else if (parse(argv[i]) < 0)
+      goto usage;
+  }
+  if (nworker == 0)
+    for (i = 0; i < sizeof(defmix) / sizeof(defmix[0]); i++) {
+      strcpy(spec, defmix[i]);
+      parse(spec);
+    }
+  ncpu = ncpus();
+  if (ticks <= 0 || benchcpu < 0 || benchcpu >= ncpu)
+    goto usage;
+
+  // Keep out of the workers' way if there is another cpu.
+  if (ncpu > 1)
+    sched_setaffinity(0, ~(1 << benchcpu));
+  for (i = 0; i < NCPU_MAX; i++)
+    curpid[i] = -1;
+  for (i = 0; i < nworker; i++)
+    start(i);
+
+  drain(0);
+  for (t = 0; t < ticks; t++) {
+    sleep(1);
+    drain(1);
+  }
+  for (i = 0; i < nworker; i++)
+    kill(w[i].pid);
+  for (i = 0; i < nworker; i++)
+    wait();
+  report(ticks, ncpu);
+  exit();
+
+usage:
+  printf(2, "usage: schedbench [-t ticks] [-c cpu] "
+            "[cpu:N] [io:N] [int:N] [stride:N:P] ...\n");
+  exit();
+}
@@ -0,0 +1,163 @@
+/**
+ *  Traces the scheduler for a number of ticks (default 100) and
+ * prints how long processes waited on a run queue, from being
+ * queued until they ran, as log2 histograms of tsc cycles:
+ * one for processes that woke up and one for those that were
+ * queued otherwise (preempted, yielding or new).
+ *
+ *  usage: schedlat [ticks]
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "schedtrace.h"
+
+#define NCPU_MAX        8
+#define NPEND           64          // queued processes tracked
+#define NBUCKET         32
+
+struct schedev ev[NCPU_MAX][NTRACE];
+int nev[NCPU_MAX];
+
+struct {
+  int pid;
+  uint tsc;
+  int wakeup;
+} pend[NPEND];
+
+uint hist[2][NBUCKET];              // [wakeup][log2 cycles]
+uint count[SEV_LOST + 1];
+uint lost;
+
+char *evname[] = {
+  [SEV_SWITCHIN]  "switch-in",
+  [SEV_SWITCHOUT] "switch-out",
+  [SEV_WAKEUP]    "wakeup",
+  [SEV_ENQUEUE]   "enqueue",
+  [SEV_PRIO]      "priority",
+  [SEV_BOOST]     "boost",
+  [SEV_PASS]      "pass",
+  [SEV_MIGRATE]   "migrate",
+  [SEV_LOST]      "lost",
+};
+
+int
+log2(uint x)
+{
+  int n = 0;
+
+  while (x >>= 1)
+    n++;
+  return n;
+}
+
+void
+account(struct schedev *e)
+{
+  int i;
+
+  count[e->type]++;
+  i = e->pid % NPEND;
+  switch (e->type) {
+  case SEV_WAKEUP:
+  case SEV_ENQUEUE:
+    pend[i].pid = e->pid;
+    pend[i].tsc = e->tsc;
+    pend[i].wakeup = (e->type == SEV_WAKEUP);
+    break;
+  case SEV_SWITCHIN:
+    if (pend[i].pid == e->pid) {
+      hist[pend[i].wakeup][log2(e->tsc - pend[i].tsc)]++;
+      pend[i].pid = 0;
+    }
+    break;
+  case SEV_LOST:
+    // A process may have been queued and run unseen.
+    lost += e->arg;
+    memset(pend, 0, sizeof(pend));
+    break;
+  }
+}
+
+// Drain every cpu's ring and account the events in time order.
+// Returns the number of cpus.
+int
+drain(int doaccount)
+{
+  int pos[NCPU_MAX];
+  int ncpu, i, best;
+
+  for (ncpu = 0; ncpu < NCPU_MAX; ncpu++) {
+    if ((nev[ncpu] = schedtrace(ncpu, ev[ncpu], NTRACE)) < 0)
+      break;
+    pos[ncpu] = 0;
+  }
+  if (!doaccount)
+    return ncpu;
+  for (;;) {
+    best = -1;
+    for (i = 0; i < ncpu; i++) {
+      if (pos[i] == nev[i])
+        continue;
+      if (best < 0
+          || (int)(ev[i][pos[i]].tsc - ev[best][pos[best]].tsc) < 0)
+        best = i;
+    }
+    if (best < 0)
+      return ncpu;
+    account(&ev[best][pos[best]++]);
+  }
+}
+
+void
+printhist(char *what, uint *h)
+{
+  int i, j, lo, hi;
+  uint n = 0, max = 0;
+
+  for (i = 0; i < NBUCKET; i++) {
+    n += h[i];
+    if (h[i] > max)
+      max = h[i];
+  }
+  printf(1, "%s run queue latency, %d samples\n", what, n);
+  if (n == 0)
+    return;
+  for (lo = 0; h[lo] == 0; lo++)
+    ;
+  for (hi = NBUCKET - 1; h[hi] == 0; hi--)
+    ;
+  for (i = lo; i <= hi; i++) {
+    printf(1, "  2^%d\t%d\t", i, h[i]);
+    for (j = 0; j < (h[i] * 40 + max - 1) / max; j++)
+      printf(1, "*");
+    printf(1, "\n");
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int t, ticks = 100, ncpu = 0;
+
+  if (argc > 1)
+    ticks = atoi(argv[1]);
+
+  // Throw away what happened before we started.
+  drain(0);
+  for (t = 0; t < ticks; t++) {
+    sleep(1);
+    ncpu = drain(1);
+  }
+
+  printf(1, "schedlat: %d ticks on %d cpus\n", ticks, ncpu);
+  for (t = 1; t <= SEV_LOST; t++)
+    if (count[t])
+      printf(1, "  %s\t%d\n", evname[t], count[t]);
+  if (lost)
+    printf(1, "  %d events lost, latencies across them dropped\n", lost);
+  printhist("wakeup", hist[1]);
+  printhist("requeue", hist[0]);
+  exit();
+}
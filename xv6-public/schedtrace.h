@@ -0,0 +1,21 @@
+// Scheduler trace events, see trace.c and schedtrace().
+#define NTRACE         1024  // events per cpu ring, a power of 2
+
+#define SEV_SWITCHIN   1  // pid starts running; arg: its class
+#define SEV_SWITCHOUT  2  // pid stops running; arg: its new state
+#define SEV_WAKEUP     3  // pid woke up and was queued; arg: ENQ_ flags
+#define SEV_ENQUEUE    4  // pid was queued otherwise (yield, fork)
+#define SEV_PRIO       5  // mlfq level of pid changed; arg: new level
+#define SEV_BOOST      6  // every mlfq process moved to level 0
+#define SEV_PASS       7  // stride pass of pid changed; arg: its lead
+                          //  over the virtual time, in STRIDE1 / 2^20
+#define SEV_MIGRATE    8  // pid runs here, last ran elsewhere; arg: that cpu
+#define SEV_LOST       9  // the ring overflowed; arg: events dropped
+
+struct schedev {
+  uint tsc;       // low 32 bits of the time stamp counter
+  ushort pid;
+  uchar type;     // SEV_
+  uchar cpu;      // cpu the event happened on
+  int arg;
+};
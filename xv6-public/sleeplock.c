@@ -10,6 +10,8 @@
 #include "spinlock.h"
 #include "sleeplock.h"
 
+#define SPIN 1000     // (iteration) acquiresleepspin() spins at most
+
 void
 initsleeplock(struct sleeplock *lk, char *name)
 {
@@ -17,26 +19,58 @@ initsleeplock(struct sleeplock *lk, char *name)
   lk->name = name;
   lk->locked = 0;
   lk->pid = 0;
+  lk->holder = 0;
 }
 
+// The holder of a lock we wait for runs with our priority until it
+// releases its last sleeplock, so that a process of lower priority
+// cannot stall us while it holds the lock.
 void
 acquiresleep(struct sleeplock *lk)
 {
+  struct proc *p = myproc();
+
   acquire(&lk->lk);
   while (lk->locked) {
+    inheritprio(lk->holder);
     sleep(lk, &lk->lk);
   }
   lk->locked = 1;
-  lk->pid = myproc()->pid;
+  lk->pid = p->pid;
+  lk->holder = p;
+  p->nsleeplock++;
   release(&lk->lk);
 }
 
+// Like acquiresleep, for locks held only briefly: as long as the
+// holder is running on another cpu, it is likely to let go before
+// we could go to sleep and be woken, so spin for a while first.
+void
+acquiresleepspin(struct sleeplock *lk)
+{
+  struct proc *h;
+  int i;
+
+  for (i = 0; i < SPIN && lk->locked; i++) {
+    h = lk->holder;
+    if (h == 0 || h->state != RUNNING)
+      break;
+    pause();
+  }
+  acquiresleep(lk);
+}
+
 void
 releasesleep(struct sleeplock *lk)
 {
+  struct proc *p = myproc();
+
   acquire(&lk->lk);
   lk->locked = 0;
   lk->pid = 0;
+  lk->holder = 0;
+  if (--p->nsleeplock == 0 && p->inherited)
+    restoreprio();
   wakeup(lk);
   release(&lk->lk);
 }
@@ -0,0 +1,389 @@
+// Stride scheduling class.
+//
+// A process in the stride class holds tickets and is charged a
+// stride of STRIDE1 / tickets each time it is picked (pass.h). The RUNNABLE
+// stride processes are kept in a min-heap ordered by pass value.
+// Every node records its heap index in p->stride.hidx so it can be
+// removed or re-ordered in O(log n).
+//
+// A process holding a sleeplock that a process with a smaller pass
+// value (or in another class) waits for has its pass value lowered
+// to the waiter's (or to that of the mlfq class, or the virtual
+// time) until it releases its last sleeplock. Strides charged
+// meanwhile still count; only the amount taken off is given back.
+//
+// The mlfq class as a whole takes part as one more client holding
+// the tickets not reserved by stride or edf processes (MAXTICKETS minus
+// total_tickets, at least MAXTICKETS - limit); when its pass value
+// is the smallest, the stride class lets the mlfq class pick.
+//
+// The reservation is work-conserving: while no mlfq process is
+// queued the mlfq class is left out, so its share goes to the
+// stride processes in proportion to their tickets. It rejoins at
+// the virtual time as soon as an mlfq process is queued, without
+// credit for the time it had nothing to run.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "sched.h"
+#include "schedtrace.h"
+#include "pass.h"
+
+static struct {
+  struct proc* p[NPROC + 1];   // runnable processes, min-heap from 1
+  int cntproc;                 // count stride nodes
+  struct spinlock lock;        // guards total_tickets and limit
+  int total_tickets;           // stride and edf tickets <= limit
+  int limit;                   // see stride_setlimit()
+  uint64 mlfqpass;             // pass value of the mlfq class
+  int mlfqidle;                // no mlfq process was queued
+  uint64 vtime;                // virtual time, see vclock()
+} stride = {
+  .limit = LIMITTICKETS,
+};
+
+static int
+comparenode(struct proc *low, struct proc *high)
+{
+  return passbefore(low->stride.passvalue, high->stride.passvalue);
+}
+
+// Swap heap nodes i and j, keeping their hidx in sync.
+static void
+swapnode(int i, int j)
+{
+  struct proc *tmp = stride.p[i];
+  stride.p[i] = stride.p[j];
+  stride.p[j] = tmp;
+  stride.p[i]->stride.hidx = i;
+  stride.p[j]->stride.hidx = j;
+}
+
+static void
+shiftup(int index)
+{
+  if (index <= 1) return ;
+  int parent = index >> 1;
+  if (comparenode(stride.p[index], stride.p[parent])) {
+    swapnode(parent, index);
+    shiftup(parent);
+  }
+}
+
+static void
+shiftdown(int index)
+{
+  int l = index * 2;
+  int r = index * 2 + 1;
+  int imin = index;
+
+  if (l <= stride.cntproc && comparenode(stride.p[l], stride.p[imin]))
+    imin = l;
+  if (r <= stride.cntproc && comparenode(stride.p[r], stride.p[imin]))
+    imin = r;
+
+  if (imin == index) return ;
+  swapnode(imin, index);
+  shiftdown(imin);
+}
+
+// Restore heap order around node index after its key changed.
+static void
+fixnode(int index)
+{
+  if (index > 1 && comparenode(stride.p[index], stride.p[index >> 1]))
+    shiftup(index);
+  else
+    shiftdown(index);
+}
+
+static void
+push(struct proc *p)
+{
+  if (p->stride.hidx)
+    panic("push");
+  int i = ++stride.cntproc;
+  stride.p[i] = p;
+  p->stride.hidx = i;
+  shiftup(i);
+}
+
+// Remove p from the heap, if it is there.
+static void
+pop_proc(struct proc* p)
+{
+  int i = p->stride.hidx;
+  int last = stride.cntproc;
+
+  if (i == 0) return ;
+  swapnode(i, last);
+  stride.p[last] = 0;
+  stride.cntproc--;
+  p->stride.hidx = 0;
+  if (i < last)
+    fixnode(i);
+}
+
+// The virtual time of the stride scheduler: the smallest pass
+// value among the mlfq class, unless it is idle, and the runnable
+// stride processes, except that it never goes back. Newcomers
+// start and sleepers wake up no earlier than this.
+static uint64
+vclock(void)
+{
+  struct proc *p = stride.cntproc > 0 ? stride.p[1] : 0;
+  uint64 pass;
+
+  if (!stride.mlfqidle)
+    pass = stride.mlfqpass;
+  else if (p)
+    pass = p->stride.passvalue;
+  else
+    return stride.vtime;
+  if (p && passbefore(p->stride.passvalue, pass))
+    pass = p->stride.passvalue;
+  if (passbefore(stride.vtime, pass))
+    stride.vtime = pass;
+  return stride.vtime;
+}
+
+// Is an mlfq process queued on any cpu?
+static int
+mlfqbusy(void)
+{
+  struct cpu *c;
+
+  for (c = cpus; c < &cpus[ncpu]; c++)
+    if (mlfq_class.nrunnable(c))
+      return 1;
+  return 0;
+}
+
+// Note whether the mlfq class has work. When it gets some after
+// being idle, it resumes no earlier than the virtual time.
+static void
+mlfqcheck(void)
+{
+  if (!mlfqbusy()) {
+    stride.mlfqidle = 1;
+  } else if (stride.mlfqidle) {
+    if (passbefore(stride.mlfqpass, vclock()))
+      stride.mlfqpass = stride.vtime;
+    stride.mlfqidle = 0;
+  }
+}
+
+// Trace a change to p's pass value.
+static void
+tracepass(struct proc *p)
+{
+  trace(SEV_PASS, p, (int)((p->stride.passvalue - stride.vtime) >> 10));
+}
+
+void
+strideinit(void)
+{
+  initlock(&stride.lock, "stride");
+}
+
+// Change the tickets reserved by a thread group or an edf process
+// from old to new. Returns -1 if that would exceed the limit.
+// The reservations have a lock of their own, so that admission
+// does not need ptable.lock; stride_pick() reads total_tickets
+// without it.
+int
+stride_reserve(int old, int new)
+{
+  int future, r = -1;
+
+  acquire(&stride.lock);
+  future = stride.total_tickets - old + new;
+  if (future <= stride.limit) {
+    stride.total_tickets = future;
+    r = 0;
+  }
+  release(&stride.lock);
+  return r;
+}
+
+// Let stride and edf processes reserve up to limit tickets,
+// leaving the mlfq class at least MAXTICKETS - limit. Returns the
+// old limit, or -1 if limit is out of range or below what is
+// reserved already.
+int
+stride_setlimit(int limit)
+{
+  int old;
+
+  if (limit < 0 || limit >= MAXTICKETS)
+    return -1;
+  acquire(&stride.lock);
+  old = stride.limit;
+  if (limit < stride.total_tickets)
+    old = -1;
+  else
+    stride.limit = limit;
+  release(&stride.lock);
+  return old;
+}
+
+// Give p the given number of tickets, moving it into the stride
+// class if it is not there yet. Caller holds ptable.lock.
+void
+stride_settickets(struct proc *p, int tickets)
+{
+  p->stride.tickets = tickets;
+  p->stride.stride = stridefor(tickets);
+  if (p->sclass != &stride_class)
+    setclass(p, &stride_class);
+}
+
+static void
+stride_init(struct proc *p)
+{
+  p->stride.passvalue = vclock();
+  p->stride.hidx = 0;
+  p->stride.lent = 0;
+}
+
+// A waking process rejoins the heap no earlier than the current
+// virtual time so that it cannot claim the cpu time it did not
+// use while asleep. Any pass lent to it is cut by as much.
+static void
+stride_enqueue(struct proc *p, int flags)
+{
+  uint64 own, pass;
+
+  if ((flags & ENQ_WAKEUP)
+      && passbefore(p->stride.passvalue, pass = vclock())) {
+    own = p->stride.passvalue + p->stride.lent;
+    p->stride.passvalue = pass;
+    p->stride.lent = passbefore(pass, own) ? own - pass : 0;
+  }
+  push(p);
+}
+
+static void
+stride_dequeue(struct proc *p)
+{
+  pop_proc(p);
+}
+
+// The process with the smallest pass value that may run on c,
+// when the root of the heap may not.
+static struct proc*
+allowedmin(struct cpu *c)
+{
+  struct proc *p = 0;
+  int i;
+
+  for (i = 2; i <= stride.cntproc; i++)
+    if (cpuallowed(stride.p[i], c)
+        && (p == 0 || comparenode(stride.p[i], p)))
+      p = stride.p[i];
+  return p;
+}
+
+// Charge p one stride up front.
+static void
+stride_charge(struct proc *p)
+{
+  p->stride.passvalue += p->stride.stride;
+  tracepass(p);
+}
+
+// Pick the process with the smallest pass value and charge it
+// one stride up front, unless it is the mlfq class's turn.
+static struct proc*
+stride_pick(struct cpu *c)
+{
+  struct proc *p;
+
+  if (stride.cntproc == 0)
+    return 0;
+  mlfqcheck();
+  vclock();
+  if (!stride.mlfqidle
+      && !passbefore(stride.p[1]->stride.passvalue, stride.mlfqpass)) {
+    // MLFQ using STRIDE
+    stride.mlfqpass += stridefor(MAXTICKETS - stride.total_tickets);
+    return 0;
+  }
+  p = stride.p[1];
+  if (!cpuallowed(p, c) && (p = allowedmin(c)) == 0)
+    return 0;
+  pop_proc(p);
+  stride_charge(p);
+  return p;
+}
+
+// Every tick is a full stride quantum.
+static int
+stride_tick(struct proc *p)
+{
+  return 1;
+}
+
+static void
+stride_yield(struct proc *p)
+{
+}
+
+// Lower p's pass value to that of the waiter from.
+static int
+stride_inherit(struct proc *p, struct proc *from)
+{
+  uint64 pass;
+
+  if (from->sclass == &stride_class)
+    pass = from->stride.passvalue;
+  else if (from->sclass == &mlfq_class)
+    pass = stride.mlfqpass;
+  else
+    pass = vclock();
+  if (!passbefore(pass, p->stride.passvalue))
+    return 0;
+  p->stride.lent += p->stride.passvalue - pass;
+  p->stride.passvalue = pass;
+  tracepass(p);
+  return 1;
+}
+
+static void
+stride_restore(struct proc *p)
+{
+  p->stride.passvalue += p->stride.lent;
+  p->stride.lent = 0;
+  tracepass(p);
+}
+
+static int
+stride_nrunnable(struct cpu *c)
+{
+  int i, n = 0;
+
+  for (i = 1; i <= stride.cntproc; i++)
+    if (cpuallowed(stride.p[i], c))
+      n++;
+  return n;
+}
+
+struct sched_class stride_class = {
+  .name = "stride",
+  .init = stride_init,
+  .enqueue = stride_enqueue,
+  .dequeue = stride_dequeue,
+  .pick_next = stride_pick,
+  .tick = stride_tick,
+  .yield = stride_yield,
+  .nrunnable = stride_nrunnable,
+  .charge = stride_charge,
+  .inherit = stride_inherit,
+  .restore = stride_restore,
+};
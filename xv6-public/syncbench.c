@@ -0,0 +1,126 @@
+/**
+ *  Lock benchmark for the usync.c mutex. NTHREAD threads of one
+ * process, confined to the first k cpus for k = 1, 2 and 8 (as far
+ * as there are cpus), each take a lock ITER times around a short
+ * critical section, doing some work of their own in between. This
+ * is done once with a test-and-test-and-set spinlock, as our apps
+ * used to, and once with a mutex.
+ *  With fewer cpus than threads a spinner can only wait for a holder
+ * that was preempted by burning its slice; the mutex sleeps instead.
+ *
+ *  usage: syncbench [iter]
+ *  Output lines are a record name followed by key=value fields.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "usync.h"
+
+#define NTHREAD         8
+#define INSIDE          50          // (iteration) in the critical section
+#define OUTSIDE         200         // (iteration) between critical sections
+
+#define SPIN            0
+#define MUTEX           1
+
+char *lockname[] = { "spin", "mutex" };
+
+int iter = 20000;
+int kind;
+int spinlock;
+struct mutex mutex;
+int counter;
+
+void
+spin(int n)
+{
+  volatile int i;
+
+  for (i = 0; i < n; i++)
+    ;
+}
+
+void
+lock(void)
+{
+  if (kind == MUTEX) {
+    mutex_lock(&mutex);
+    return;
+  }
+  while (__sync_lock_test_and_set(&spinlock, 1) != 0)
+    while (spinlock)
+      ;
+}
+
+void
+unlock(void)
+{
+  if (kind == MUTEX)
+    mutex_unlock(&mutex);
+  else
+    __sync_lock_release(&spinlock);
+}
+
+void*
+worker(void *arg)
+{
+  int i;
+
+  for (i = 0; i < iter; i++) {
+    lock();
+    counter++;
+    spin(INSIDE);
+    unlock();
+    spin(OUTSIDE);
+  }
+  thread_exit(0);
+}
+
+// Run the threads on the first ncpu cpus, return the ticks taken.
+int
+run(int ncpu)
+{
+  thread_t t[NTHREAD];
+  void *ret;
+  uint start;
+  int i;
+
+  sched_setaffinity(0, (1 << ncpu) - 1);
+  counter = 0;
+  start = uptime();
+  for (i = 0; i < NTHREAD; i++)
+    if (thread_create(&t[i], worker, 0) != 0) {
+      printf(2, "syncbench: thread_create failed\n");
+      exit();
+    }
+  for (i = 0; i < NTHREAD; i++)
+    thread_join(t[i], &ret);
+  if (counter != NTHREAD * iter)
+    printf(2, "syncbench: %s lost updates: %d of %d\n",
+           lockname[kind], counter, NTHREAD * iter);
+  return uptime() - start;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int want[] = { 1, 2, 8 };
+  int ncpu, i, ticks;
+
+  if (argc > 1)
+    iter = atoi(argv[1]);
+  ncpu = ncpus();
+
+  for (i = 0; i < sizeof(want) / sizeof(want[0]); i++) {
+    if (want[i] > ncpu)
+      break;
+    for (kind = SPIN; kind <= MUTEX; kind++) {
+      ticks = run(want[i]);
+      printf(1, "syncbench lock=%s cpus=%d threads=%d iter=%d ticks=%d "
+                "ops_per_tick=%d\n", lockname[kind], want[i], NTHREAD,
+             iter, ticks, NTHREAD * iter / (ticks ? ticks : 1));
+    }
+  }
+  exit();
+}
@@ -4,6 +4,9 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "mm.h"
 #include "x86.h"
 #include "syscall.h"
 
@@ -19,7 +22,7 @@ fetchint(uint addr, int *ip)
 {
   struct proc *curproc = myproc();
 
-  if(addr >= curproc->sz || addr+4 > curproc->sz)
+  if(addr >= curproc->mm->sz || addr+4 > curproc->mm->sz)
     return -1;
   *ip = *(int*)(addr);
   return 0;
@@ -34,10 +37,10 @@ fetchstr(uint addr, char **pp)
   char *s, *ep;
   struct proc *curproc = myproc();
 
-  if(addr >= curproc->sz)
+  if(addr >= curproc->mm->sz)
     return -1;
   *pp = (char*)addr;
-  ep = (char*)curproc->sz;
+  ep = (char*)curproc->mm->sz;
   for(s = *pp; s < ep; s++){
     if(*s == 0)
       return s - *pp;
@@ -63,7 +66,7 @@ argptr(int n, char **pp, int size)
  
   if(argint(n, &i) < 0)
     return -1;
-  if(size < 0 || (uint)i >= curproc->sz || (uint)i+size > curproc->sz)
+  if(size < 0 || (uint)i >= curproc->mm->sz || (uint)i+size > curproc->mm->sz)
     return -1;
   *pp = (char*)i;
   return 0;
@@ -116,6 +119,21 @@ extern int sys_printallstate(void);
 /* Proj5 File */
 extern int sys_pwrite(void);
 extern int sys_pread(void);
+/* Scheduler */
+extern int sys_getcpustat(void);
+extern int sys_set_deadline(void);
+extern int sys_getmlfqparam(void);
+extern int sys_setmlfqparam(void);
+extern int sys_yield_to(void);
+extern int sys_set_gang(void);
+extern int sys_sched_setaffinity(void);
+extern int sys_sched_getaffinity(void);
+extern int sys_schedtrace(void);
+extern int sys_set_mlfq_floor(void);
+extern int sys_futex_wait(void);
+extern int sys_futex_wake(void);
+extern int sys_thread_join_any(void);
+extern int sys_thread_detach(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -150,6 +168,20 @@ static int (*syscalls[])(void) = {
 [SYS_printallstate] sys_printallstate,
 [SYS_pwrite] sys_pwrite,
 [SYS_pread]  sys_pread,
+[SYS_getcpustat] sys_getcpustat,
+[SYS_set_deadline] sys_set_deadline,
+[SYS_getmlfqparam] sys_getmlfqparam,
+[SYS_setmlfqparam] sys_setmlfqparam,
+[SYS_yield_to] sys_yield_to,
+[SYS_set_gang] sys_set_gang,
+[SYS_sched_setaffinity] sys_sched_setaffinity,
+[SYS_sched_getaffinity] sys_sched_getaffinity,
+[SYS_schedtrace] sys_schedtrace,
+[SYS_set_mlfq_floor] sys_set_mlfq_floor,
+[SYS_futex_wait] sys_futex_wait,
+[SYS_futex_wake] sys_futex_wake,
+[SYS_thread_join_any] sys_thread_join_any,
+[SYS_thread_detach] sys_thread_detach,
 };
 
 void
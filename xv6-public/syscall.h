@@ -31,3 +31,17 @@
 #define SYS_printallstate 30
 #define SYS_pwrite 31
 #define SYS_pread  32
+#define SYS_getcpustat 33
+#define SYS_set_deadline 34
+#define SYS_getmlfqparam 35
+#define SYS_setmlfqparam 36
+#define SYS_yield_to   37
+#define SYS_set_gang   38
+#define SYS_sched_setaffinity 39
+#define SYS_sched_getaffinity 40
+#define SYS_schedtrace 41
+#define SYS_set_mlfq_floor 42
+#define SYS_futex_wait 43
+#define SYS_futex_wake 44
+#define SYS_thread_join_any 45
+#define SYS_thread_detach 46
@@ -6,6 +6,11 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
+#include "spinlock.h"
+#include "timer.h"
+#include "cpustat.h"
+#include "mlfqparam.h"
+#include "schedtrace.h"
 
 int
 sys_fork(void)
@@ -109,12 +114,165 @@ sys_thread_exit(void)
   return -1;
 }
 
+int
+sys_thread_join_any(void)
+{
+  thread_t *thread;
+  void **retval;
+
+  if (argptr(0, (void*)&thread, sizeof(*thread)) < 0)
+    return -1;
+  if (argptr(1, (void*)&retval, sizeof(*retval)) < 0)
+    return -1;
+  return thread_join_any(thread, retval);
+}
+
+int
+sys_thread_detach(void)
+{
+  thread_t thread;
+
+  if (argint(0, (int*)&thread) < 0)
+    return -1;
+  return thread_detach(thread);
+}
+
 void
 sys_printallstate(void)
 {
   printallstate();
 }
 
+int
+sys_getcpustat(void)
+{
+  int n;
+  struct cpustat *st;
+
+  if (argint(0, &n) < 0)
+    return -1;
+  if (argptr(1, (void*)&st, sizeof(*st)) < 0)
+    return -1;
+  return getcpustat(n, st);
+}
+
+int
+sys_set_deadline(void)
+{
+  int runtime, period;
+
+  if (argint(0, &runtime) < 0 || argint(1, &period) < 0)
+    return -1;
+  return set_deadline(runtime, period);
+}
+
+int
+sys_getmlfqparam(void)
+{
+  struct mlfqparam *mp;
+
+  if (argptr(0, (void*)&mp, sizeof(*mp)) < 0)
+    return -1;
+  return getmlfqparam(mp);
+}
+
+int
+sys_setmlfqparam(void)
+{
+  struct mlfqparam *mp, param;
+
+  if (argptr(0, (void*)&mp, sizeof(*mp)) < 0)
+    return -1;
+  param = *mp;
+  return setmlfqparam(&param);
+}
+
+int
+sys_yield_to(void)
+{
+  thread_t thread;
+
+  if (argint(0, (int*)&thread) < 0)
+    return -1;
+  return yield_to(thread);
+}
+
+int
+sys_set_gang(void)
+{
+  int on;
+
+  if (argint(0, &on) < 0)
+    return -1;
+  return set_gang(on);
+}
+
+int
+sys_sched_setaffinity(void)
+{
+  int pid, mask;
+
+  if (argint(0, &pid) < 0 || argint(1, &mask) < 0)
+    return -1;
+  return sched_setaffinity(pid, mask);
+}
+
+int
+sys_sched_getaffinity(void)
+{
+  int pid;
+  uint *mask;
+
+  if (argint(0, &pid) < 0 || argptr(1, (void*)&mask, sizeof(*mask)) < 0)
+    return -1;
+  return sched_getaffinity(pid, mask);
+}
+
+int
+sys_schedtrace(void)
+{
+  int cpu, n;
+  struct schedev *buf;
+
+  if (argint(0, &cpu) < 0 || argint(2, &n) < 0 || n <= 0)
+    return -1;
+  if (n > NTRACE)
+    n = NTRACE;
+  if (argptr(1, (void*)&buf, n * sizeof(*buf)) < 0)
+    return -1;
+  return schedtrace(cpu, buf, n);
+}
+
+int
+sys_set_mlfq_floor(void)
+{
+  int percent;
+
+  if (argint(0, &percent) < 0)
+    return -1;
+  return set_mlfq_floor(percent);
+}
+
+int
+sys_futex_wait(void)
+{
+  int addr, val;
+
+  if (argint(0, &addr) < 0 || argint(1, &val) < 0)
+    return -1;
+  return futex_wait(addr, val);
+}
+
+int
+sys_futex_wake(void)
+{
+  int addr, n;
+
+  if (argint(0, &addr) < 0 || argint(1, &n) < 0 || n < 0)
+    return -1;
+  return futex_wake(addr, n);
+}
+
 int
 sys_sbrk(void)
 {
@@ -123,29 +281,39 @@ sys_sbrk(void)
 
   if(argint(0, &n) < 0)
     return -1;
-  addr = myproc()->main_thread->heap;
-  if(growproc(n) < 0)
+  if((addr = growproc(n)) < 0)
     return -1;
   return addr;
 }
 
+// Sleep on a timer of our own, so that only this process
+// is woken when the n ticks are up.
 int
 sys_sleep(void)
 {
   int n;
-  uint ticks0;
+  struct timer t;
 
   if(argint(0, &n) < 0)
     return -1;
+  if(n <= 0)
+    return 0;
   acquire(&tickslock);
-  ticks0 = ticks;
-  while(ticks - ticks0 < n){
+  t.pending = 0;
+  timeradd(&t, ticks + n, wakeup, &t);
+  // t lives on our kernel stack; whoever frees the stack
+  // while we sleep disarms it first (exitproc()).
+  myproc()->timer = &t;
+  while(t.pending){
     if(myproc()->killed){
+      timerdel(&t);
+      myproc()->timer = 0;
       release(&tickslock);
       return -1;
     }
-    sleep(&ticks, &tickslock);
+    sleep(&t, &tickslock);
   }
+  myproc()->timer = 0;
   release(&tickslock);
   return 0;
 }
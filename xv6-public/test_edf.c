@@ -0,0 +1,73 @@
+/**
+ *  Checks the edf scheduling class.
+ *  First, admission: a reservation that does not fit next to an
+ * existing one is refused.
+ *  Then latency: a process with a deadline wakes up every PERIOD
+ * ticks while NHOG cpu hogs run, and reports how late it ran.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define NHOG            4
+#define NROUND          50
+#define PERIOD          5           // (ticks)
+
+void
+hog(void)
+{
+  for (;;)
+    __sync_synchronize();
+}
+
+int
+main(int argc, char *argv[])
+{
+  int pid[NHOG];
+  int i, late, maxlate, sumlate;
+  uint start;
+
+  // Admission control shares capacity with stride (80%).
+  if (set_deadline(5, 10) < 0) {
+    printf(1, "edf: cannot reserve 50%%\n");
+    exit();
+  }
+  if (fork() == 0) {
+    if (set_deadline(4, 10) == 0)
+      printf(1, "edf: admitted 40%% next to 50%%: FAIL\n");
+    else
+      printf(1, "edf: refused 40%% next to 50%%: OK\n");
+    exit();
+  }
+  wait();
+  if (set_deadline(0, 0) < 0 || set_deadline(8, 10) < 0) {
+    printf(1, "edf: cannot reserve 80%% after release: FAIL\n");
+    exit();
+  }
+  set_deadline(0, 0);
+
+  for (i = 0; i < NHOG; i++)
+    if ((pid[i] = fork()) == 0)
+      hog();
+
+  set_deadline(1, PERIOD);
+  maxlate = sumlate = 0;
+  for (i = 0; i < NROUND; i++) {
+    start = uptime();
+    sleep(PERIOD);
+    late = uptime() - start - PERIOD;
+    sumlate += late;
+    if (late > maxlate)
+      maxlate = late;
+  }
+  set_deadline(0, 0);
+
+  for (i = 0; i < NHOG; i++) {
+    kill(pid[i]);
+    wait();
+  }
+  printf(1, "edf: %d wakeups with %d hogs, late max %d total %d ticks\n",
+         NROUND, NHOG, maxlate, sumlate);
+  exit();
+}
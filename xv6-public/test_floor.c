@@ -0,0 +1,104 @@
+/**
+ *  Checks set_mlfq_floor() and the work-conserving mlfq reservation.
+ *  First, the floor limits what set_cpu_share() may reserve, and
+ * cannot be raised over what is reserved.
+ *  Then a 20% stride process runs on cpu 0 alone, where it should
+ * get the whole cpu, and next to an mlfq hog, which should take
+ * back its 80% at once.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define RUN             100         // (ticks)
+#define CHUNK           10000       // (iteration)
+
+// Count chunks of work on cpu 0 for RUN ticks and report them on fd.
+void
+worker(int pct, int fd)
+{
+  volatile int i;
+  uint end, n = 0;
+
+  sched_setaffinity(0, 1);
+  if (pct && set_cpu_share(pct) < 0) {
+    printf(1, "floor: cannot set cpu share %d\n", pct);
+    exit();
+  }
+  end = uptime() + RUN;
+  while (uptime() < end) {
+    for (i = 0; i < CHUNK; i++)
+      ;
+    n++;
+  }
+  write(fd, &n, sizeof(n));
+  exit();
+}
+
+// Run workers with the given shares (0 for mlfq) side by side and
+// return their counts in n.
+void
+race(int *pct, uint *n, int nworker)
+{
+  int fd[2], i;
+
+  pipe(fd);
+  for (i = 0; i < nworker; i++)
+    if (fork() == 0)
+      worker(pct[i], fd[1]);
+  for (i = 0; i < nworker; i++)
+    wait();
+  for (i = 0; i < nworker; i++)
+    read(fd[0], &n[i], sizeof(n[i]));
+  close(fd[0]);
+  close(fd[1]);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int fd[2], old, pct[2];
+  uint base, n[2];
+  char c;
+
+  if (set_mlfq_floor(0) >= 0 || set_mlfq_floor(101) >= 0)
+    printf(1, "floor: accepted a floor out of range: FAIL\n");
+  old = set_mlfq_floor(50);
+  printf(1, "floor: default floor %d%%\n", old);
+
+  pipe(fd);
+  if (fork() == 0) {
+    if (set_cpu_share(60) >= 0)
+      printf(1, "floor: reserved 60%% over a 50%% floor: FAIL\n");
+    if (set_cpu_share(40) < 0)
+      printf(1, "floor: cannot reserve 40%% under a 50%% floor: FAIL\n");
+    write(fd[1], "x", 1);
+    sleep(20);
+    exit();
+  }
+  read(fd[0], &c, 1);
+  if (set_mlfq_floor(70) >= 0)
+    printf(1, "floor: raised the floor over a reservation: FAIL\n");
+  wait();
+  close(fd[0]);
+  close(fd[1]);
+  set_mlfq_floor(old);
+
+  // Stay off cpu 0 if we can.
+  sched_setaffinity(0, ~1);
+
+  pct[0] = 0;
+  race(pct, n, 1);
+  base = n[0];
+  pct[0] = 20;
+  race(pct, n, 1);
+  printf(1, "floor: a 20%% stride process alone got %d%% of the cpu\n",
+         n[0] * 100 / base);
+
+  pct[1] = 0;
+  race(pct, n, 2);
+  printf(1, "floor: next to an mlfq hog it got %d%%, the hog %d%%\n",
+         n[0] * 100 / base, n[1] * 100 / base);
+  exit();
+}
@@ -0,0 +1,96 @@
+/**
+ *  NWORKER threads run ROUNDS rounds of a spinning barrier next to
+ * NHOG cpu-bound processes, first as ordinary threads and then as a
+ * gang (set_gang()). A descheduled worker holds up every other one
+ * at the barrier, so co-scheduling them shortens the run.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "cpustat.h"
+
+#define NWORKER         2
+#define NHOG            2
+#define ROUNDS          300
+
+volatile int arrived;
+volatile int generation;
+
+void
+barrier(void)
+{
+  int gen = generation;
+
+  if (__sync_add_and_fetch(&arrived, 1) == NWORKER) {
+    arrived = 0;
+    __sync_synchronize();
+    generation = gen + 1;
+  } else {
+    while (generation == gen)
+      ;
+  }
+}
+
+void*
+worker(void *arg)
+{
+  int i, j;
+
+  for (i = 0; i < ROUNDS; i++) {
+    for (j = 0; j < 100000; j++)
+      __sync_synchronize();
+    barrier();
+  }
+  thread_exit(0);
+}
+
+uint
+ngang(void)
+{
+  struct cpustat st;
+
+  sumcpustat(&st);
+  return st.ngang;
+}
+
+void
+run(int gang)
+{
+  thread_t t[NWORKER];
+  void *ret;
+  uint start, g;
+  int i;
+
+  set_gang(gang);
+  arrived = generation = 0;
+  g = ngang();
+  start = uptime();
+  for (i = 0; i < NWORKER; i++)
+    thread_create(&t[i], worker, 0);
+  for (i = 0; i < NWORKER; i++)
+    thread_join(t[i], &ret);
+  printf(1, "gang %d: %d rounds in %d ticks, %d gang picks\n",
+         gang, ROUNDS, uptime() - start, ngang() - g);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int pid[NHOG];
+  int i;
+
+  for (i = 0; i < NHOG; i++)
+    if ((pid[i] = fork()) == 0)
+      for (;;)
+        __sync_synchronize();
+
+  run(0);
+  run(1);
+
+  for (i = 0; i < NHOG; i++) {
+    kill(pid[i]);
+    wait();
+  }
+  exit();
+}
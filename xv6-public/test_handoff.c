@@ -0,0 +1,90 @@
+/**
+ *  Two threads of one process pass a token back and forth through a
+ * pair of pipes. Each time a thread wakes its sibling and then blocks
+ * on the other pipe, the kernel hands the cpu straight to the sibling.
+ *  Reports the time for ROUNDS round trips and how many hand-offs
+ * the cpus made, then checks yield_to().
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "cpustat.h"
+
+#define ROUNDS          2000
+
+int ping[2], pong[2];
+
+void*
+ponger(void *arg)
+{
+  int i;
+  char c;
+
+  for (i = 0; i < ROUNDS; i++) {
+    read(ping[0], &c, 1);
+    write(pong[1], &c, 1);
+  }
+  thread_exit(0);
+}
+
+void*
+spinner(void *arg)
+{
+  volatile int *stop = arg;
+
+  while (!*stop)
+    ;
+  thread_exit(0);
+}
+
+uint
+nhandoff(void)
+{
+  struct cpustat st;
+
+  sumcpustat(&st);
+  return st.nhandoff;
+}
+
+int
+main(int argc, char *argv[])
+{
+  thread_t t;
+  void *ret;
+  uint start, h;
+  int i;
+  volatile int stop = 0;
+  int fail = 0;
+  char c = 'x';
+
+  pipe(ping);
+  pipe(pong);
+  h = nhandoff();
+  start = uptime();
+  thread_create(&t, ponger, 0);
+  for (i = 0; i < ROUNDS; i++) {
+    write(ping[1], &c, 1);
+    read(pong[0], &c, 1);
+  }
+  thread_join(t, &ret);
+  printf(1, "handoff: %d round trips in %d ticks, %d hand-offs\n",
+         ROUNDS, uptime() - start, nhandoff() - h);
+
+  if (yield_to(getpid()) == 0 || yield_to(1) == 0)
+    printf(1, "handoff: yield_to outside this process: FAIL\n");
+  // The spinner never blocks, so with both threads on one cpu
+  // it is RUNNABLE whenever we run.
+  sched_setaffinity(0, 1);
+  thread_create(&t, spinner, (void*)&stop);
+  for (i = 0; i < 10; i++)
+    if (yield_to(t) != 0)
+      fail++;
+  stop = 1;
+  thread_join(t, &ret);
+  if (fail)
+    printf(1, "handoff: yield_to sibling failed %d of 10: FAIL\n", fail);
+  else
+    printf(1, "handoff: yield_to OK\n");
+  exit();
+}
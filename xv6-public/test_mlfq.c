@@ -3,11 +3,19 @@
  * MLFQ scheduler which is containing this process.
  *  Periodically yield if given parameter value is 1
  *  Do not yield itself if given parameter value is 0
+ *  With parameter "sweep", runs a mix of compute and interactive
+ * processes under several MLFQ settings (setmlfqparam()) and reports
+ * throughput and response time for each.
+ *  With parameter "group", runs a process with GROUP_THREADS threads
+ * next to a single-threaded one, without and with group-fair mode,
+ * and reports the work each got done.
  */
 
 #include "types.h"
 #include "stat.h"
 #include "user.h"
+#include "param.h"
+#include "mlfqparam.h"
 
 #define LIFETIME        200000000   // (iteration)
 #define YIELD_PERIOD    10000       // (iteration)
@@ -15,6 +23,178 @@
 // Number of level(priority) of MLFQ scheduler
 #define MLFQ_LEVEL      3
 
+#define SWEEP_TICKS     300         // (ticks) per configuration
+#define SWEEP_COMPUTE   2           // compute-bound processes
+#define SWEEP_INTERACT  2           // processes that sleep a tick
+
+#define GROUP_TICKS     300         // (ticks) per mode
+#define GROUP_THREADS   8
+
+struct mlfqparam configs[] = {
+    // nlevel, quantum, allotment, boost, aging
+    {3, {1, 2, 4}, {5, 10}, 100, 0},
+    {3, {1, 2, 4}, {5, 10}, 100, 50},
+    {2, {1, 4}, {4}, 50, 0},
+    {4, {1, 2, 4, 8}, {2, 4, 8}, 200, 0},
+    {4, {1, 2, 4, 8}, {2, 4, 8}, 0, 20},
+    {1, {2}, {0}, 0, 0},
+};
+
+// Count iterations until the deadline; report {0, count} to fd.
+void
+compute(int fd, uint end)
+{
+    int res[3] = {0, 0, 0};
+    uint i;
+
+    while (uptime() < end) {
+        for (i = 0; i < YIELD_PERIOD; i++)
+            __sync_synchronize();
+        res[1]++;
+    }
+    write(fd, res, sizeof(res));
+    exit();
+}
+
+// Sleep a tick at a time until the deadline and add up how many
+// ticks late each wakeup ran; report {1, late, wakeups} to fd.
+void
+interact(int fd, uint end)
+{
+    int res[3] = {1, 0, 0};
+    uint start;
+
+    while ((start = uptime()) < end) {
+        sleep(1);
+        res[1] += uptime() - start - 1;
+        res[2]++;
+    }
+    write(fd, res, sizeof(res));
+    exit();
+}
+
+void
+sweep(void)
+{
+    struct mlfqparam saved;
+    int fds[2];
+    int c, i, n, total, res[3], late, wakeups;
+    uint end;
+
+    getmlfqparam(&saved);
+    for (c = 0; c < sizeof(configs) / sizeof(configs[0]); c++) {
+        if (setmlfqparam(&configs[c]) < 0) {
+            printf(1, "MLFQ sweep: config %d rejected\n", c);
+            continue;
+        }
+        pipe(fds);
+        end = uptime() + SWEEP_TICKS;
+        for (i = 0; i < SWEEP_COMPUTE + SWEEP_INTERACT; i++) {
+            if (fork() == 0) {
+                close(fds[0]);
+                if (i < SWEEP_COMPUTE)
+                    compute(fds[1], end);
+                interact(fds[1], end);
+            }
+        }
+        close(fds[1]);
+        for (i = 0; i < SWEEP_COMPUTE + SWEEP_INTERACT; i++)
+            wait();
+
+        total = late = wakeups = 0;
+        while (read(fds[0], res, sizeof(res)) == sizeof(res)) {
+            if (res[0] == 0) {
+                total += res[1];
+            } else {
+                late += res[1];
+                wakeups += res[2];
+            }
+        }
+        close(fds[0]);
+
+        printf(1, "MLFQ(sweep) levels %d quantum", configs[c].nlevel);
+        for (n = 0; n < configs[c].nlevel; n++)
+            printf(1, " %d", configs[c].quantum[n]);
+        printf(1, " boost %d aging %d: throughput %d, "
+                "response %d/%d ticks late\n", configs[c].boost,
+                configs[c].aging, total, late, wakeups);
+    }
+    setmlfqparam(&saved);
+}
+
+uint group_end;
+int group_cnt[GROUP_THREADS];
+
+void*
+group_worker(void *arg)
+{
+    int *cnt = arg;
+    uint i;
+
+    while (uptime() < group_end) {
+        for (i = 0; i < YIELD_PERIOD; i++)
+            __sync_synchronize();
+        (*cnt)++;
+    }
+    thread_exit(0);
+}
+
+// Run GROUP_THREADS workers and report their total work to fd.
+void
+group_threads(int fd)
+{
+    thread_t t[GROUP_THREADS];
+    void *ret;
+    int i, total = 0;
+
+    for (i = 0; i < GROUP_THREADS; i++)
+        thread_create(&t[i], group_worker, &group_cnt[i]);
+    for (i = 0; i < GROUP_THREADS; i++) {
+        thread_join(t[i], &ret);
+        total += group_cnt[i];
+    }
+    write(fd, &total, sizeof(total));
+    exit();
+}
+
+void
+group(void)
+{
+    struct mlfqparam saved, param;
+    int multi[2], single[2];
+    int mode, total, res[3];
+
+    getmlfqparam(&saved);
+    for (mode = 0; mode <= 1; mode++) {
+        param = saved;
+        param.groupfair = mode;
+        if (setmlfqparam(&param) < 0) {
+            printf(1, "MLFQ group: mode %d rejected\n", mode);
+            continue;
+        }
+        group_end = uptime() + GROUP_TICKS;
+        pipe(multi);
+        pipe(single);
+        if (fork() == 0)
+            group_threads(multi[1]);
+        if (fork() == 0)
+            compute(single[1], group_end);
+        close(multi[1]);
+        close(single[1]);
+        wait();
+        wait();
+
+        total = res[1] = 0;
+        read(multi[0], &total, sizeof(total));
+        read(single[0], res, sizeof(res));
+        close(multi[0]);
+        close(single[0]);
+        printf(1, "MLFQ(group) groupfair %d: %d threads %d, 1 thread %d\n",
+                mode, GROUP_THREADS, total, res[1]);
+    }
+    setmlfqparam(&saved);
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -24,7 +204,16 @@ main(int argc, char *argv[])
     int curr_mlfq_level;
 
     if (argc < 2) {
-        printf(1, "usage: sched_test_mlfq do_yield_or_not(0|1)\n");
+        printf(1, "usage: sched_test_mlfq do_yield_or_not(0|1)|sweep|group\n");
+        exit();
+    }
+
+    if (strcmp(argv[1], "sweep") == 0) {
+        sweep();
+        exit();
+    }
+    if (strcmp(argv[1], "group") == 0) {
+        group();
         exit();
     }
 
@@ -0,0 +1,146 @@
+/**
+ *  Simulates the stride class deciding HOURS hours of ticks between
+ * the mlfq class and a set of stride clients, once with the old
+ * arithmetic (int pass values, STRIDE 10000 truncated per client)
+ * and once with the 64-bit fixed-point arithmetic of pass.h, whose
+ * pass values start just short of wrapping around.
+ *  Halfway through, one more client joins at the virtual time.
+ * Each half, every client should get its tickets' share of the
+ * ticks; the largest error must stay below 1% with pass.h.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "pass.h"
+
+#define HZ              100
+#define HOURS           6
+#define TICKS           (HZ * 3600 * HOURS)
+#define MAXTICKETS      1000
+#define OLDSTRIDE       10000
+#define NCLIENT         6           // mlfq, then stride clients
+#define MAXERR          100         // (basis points)
+
+int tickets[NCLIENT] = { 0, 30, 70, 130, 170, 100 };
+
+struct {
+  uint64 pass;
+  uint stride;
+  int oldpass;
+  int oldstride;
+  int active;
+  uint got;
+} c[NCLIENT];
+
+uint64 vtime;
+int oldvtime;
+
+// Give the mlfq class the tickets the active clients did not take.
+void
+setmlfq(void)
+{
+  int i, t = MAXTICKETS;
+
+  for (i = 1; i < NCLIENT; i++)
+    if (c[i].active)
+      t -= tickets[i];
+  tickets[0] = t;
+  c[0].stride = stridefor(t);
+  c[0].oldstride = OLDSTRIDE / t;
+}
+
+void
+join(int i)
+{
+  c[i].active = 1;
+  c[i].pass = vtime;
+  c[i].oldpass = oldvtime;
+  c[i].stride = stridefor(tickets[i]);
+  c[i].oldstride = OLDSTRIDE / tickets[i];
+  setmlfq();
+}
+
+// One decision as stride_pick() makes it: the mlfq class runs
+// unless a stride client's pass value is strictly smaller.
+void
+tick(int old)
+{
+  int i, best = 0;
+
+  for (i = 1; i < NCLIENT; i++) {
+    if (!c[i].active)
+      continue;
+    if (old ? c[i].oldpass < c[best].oldpass
+            : passbefore(c[i].pass, c[best].pass))
+      best = i;
+  }
+  if (old) {
+    if (c[best].oldpass > oldvtime)
+      oldvtime = c[best].oldpass;
+    c[best].oldpass += c[best].oldstride;
+  } else {
+    if (passbefore(vtime, c[best].pass))
+      vtime = c[best].pass;
+    c[best].pass += c[best].stride;
+  }
+  c[best].got++;
+}
+
+// The largest share error of the active clients over n ticks,
+// in basis points.
+int
+maxerr(int n)
+{
+  int i, max = 0;
+  uint want, diff, err;
+
+  for (i = 0; i < NCLIENT; i++) {
+    if (!c[i].active)
+      continue;
+    want = tickets[i] * (n / MAXTICKETS);
+    diff = c[i].got > want ? c[i].got - want : want - c[i].got;
+    err = diff < 400000 ? diff * 10000 / want : 10000;
+    if (err > max)
+      max = err;
+    c[i].got = 0;
+  }
+  return max;
+}
+
+int
+run(int old)
+{
+  int i, t, err, max = 0;
+
+  memset(c, 0, sizeof(c));
+  vtime = -(1ULL << 40);
+  oldvtime = 0;
+  c[0].active = 1;
+  c[0].pass = vtime;
+  for (i = 1; i < NCLIENT - 1; i++)
+    join(i);
+  for (t = 0; t < TICKS / 2; t++)
+    tick(old);
+  max = maxerr(TICKS / 2);
+
+  join(NCLIENT - 1);
+  for (; t < TICKS; t++)
+    tick(old);
+  if ((err = maxerr(TICKS / 2)) > max)
+    max = err;
+  return max;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int olderr, err;
+
+  olderr = run(1);
+  err = run(0);
+  printf(1, "stridesim: %d hours, max share error int %d bp, "
+            "64-bit %d bp: %s\n", HOURS, olderr, err,
+         err < MAXERR ? "OK" : "FAIL");
+  exit();
+}
@@ -1,9 +1,11 @@
 #include "types.h"
 #include "stat.h"
 #include "user.h"
+#include "cpustat.h"
+#include "usync.h"
 
 #define NUM_THREAD 10
-#define NTEST 15
+#define NTEST 21
 
 // Show race condition
 int racingtest(void);
@@ -44,6 +46,24 @@ int sleeptest(void);
 int stridetest1(void);
 int stridetest2(void);
 
+// Compare workers pinned to cpus with sched_setaffinity and free ones
+int affinitytest(void);
+
+// Fix the race of racingtest with a lock built on futex_wait/futex_wake
+int futextest(void);
+
+// Test barriers, reader-writer locks and semaphores of usync.c
+int synctest(void);
+
+// Test thread_join_any and thread_detach
+int detachtest(void);
+
+// Measure thread create/join throughput
+int joinbench(void);
+
+// Test that threads keep running after the main thread exits
+int mainexittest(void);
+
 int gcnt;
 int gpipe[2];
 
@@ -63,6 +83,12 @@ int (*testfunc[NTEST])(void) = {
   sleeptest,
   stridetest1,
   stridetest2,
+  affinitytest,
+  futextest,
+  synctest,
+  detachtest,
+  joinbench,
+  mainexittest,
 };
 char *testname[NTEST] = {
   "racingtest",
@@ -80,6 +106,12 @@ char *testname[NTEST] = {
   "sleeptest",
   "stridetest1",
   "stridetest2",
+  "affinitytest",
+  "futextest",
+  "synctest",
+  "detachtest",
+  "joinbench",
+  "mainexittest",
 };
 
 int
@@ -740,3 +772,416 @@ stridetest2(void)
 }
 
 // ============================================================================
+
+#define NUM_AFF 4
+#define AFFBUF 16384
+
+char affbuf[NUM_AFF][AFFBUF];
+int affcnt[NUM_AFF];
+uint affmask[NUM_AFF];
+volatile int affstop;
+
+void*
+affinitythreadmain(void *arg)
+{
+  int tid = (int)arg;
+  int i;
+
+  if (affmask[tid] && sched_setaffinity(0, affmask[tid]) != 0){
+    printf(1, "panic at sched_setaffinity\n");
+    thread_exit((void*)-1);
+  }
+  // Walk a private working set that fits in a cpu's cache.
+  while (!affstop){
+    for (i = 0; i < AFFBUF; i += 64)
+      affbuf[tid][i]++;
+    affcnt[tid]++;
+  }
+  thread_exit(0);
+}
+
+int
+affinityrun(int pinned, int ncpu)
+{
+  thread_t threads[NUM_AFF];
+  struct cpustat st;
+  uint migrate;
+  int i, total;
+  void *retval;
+
+  sumcpustat(&st);
+  migrate = st.nmigrate;
+  affstop = 0;
+  for (i = 0; i < NUM_AFF; i++){
+    affcnt[i] = 0;
+    affmask[i] = pinned ? 1 << (i % ncpu) : 0;
+    if (thread_create(&threads[i], affinitythreadmain, (void*)i) != 0){
+      printf(1, "panic at thread_create\n");
+      return -1;
+    }
+  }
+  sleep(300);
+  affstop = 1;
+  total = 0;
+  for (i = 0; i < NUM_AFF; i++){
+    if (thread_join(threads[i], &retval) != 0 || retval != 0){
+      printf(1, "panic at thread_join\n");
+      return -1;
+    }
+    total += affcnt[i];
+  }
+  sumcpustat(&st);
+  migrate = st.nmigrate - migrate;
+  printf(1, "%s : %d passes, %d migrations\n",
+         pinned ? "pinned" : "free", total, migrate);
+  return 0;
+}
+
+int
+affinitytest(void)
+{
+  uint mask;
+  int ncpu;
+
+  ncpu = ncpus();
+  if (sched_getaffinity(0, &mask) != 0 || mask != (1 << ncpu) - 1){
+    printf(1, "panic at sched_getaffinity\n");
+    return -1;
+  }
+  if (sched_setaffinity(0, 0) == 0){
+    printf(1, "panic at sched_setaffinity with empty mask\n");
+    return -1;
+  }
+  if (affinityrun(0, ncpu) != 0 || affinityrun(1, ncpu) != 0)
+    return -1;
+  return 0;
+}
+
+// ============================================================================
+// 0: unlocked, 1: locked, 2: locked and maybe waited on.
+int futexword;
+int nfutexwait;
+
+void
+futexlock(int *l)
+{
+  int c;
+
+  if ((c = __sync_val_compare_and_swap(l, 0, 1)) == 0)
+    return;
+  if (c != 2)
+    c = __sync_lock_test_and_set(l, 2);
+  while (c != 0) {
+    __sync_fetch_and_add(&nfutexwait, 1);
+    futex_wait(l, 2);
+    c = __sync_lock_test_and_set(l, 2);
+  }
+}
+
+void
+futexunlock(int *l)
+{
+  if (__sync_fetch_and_sub(l, 1) != 1) {
+    *l = 0;
+    futex_wake(l, 1);
+  }
+}
+
+void*
+futexthreadmain(void *arg)
+{
+  int tid = (int) arg;
+  int i;
+  int tmp;
+  for (i = 0; i < 1000000; i++){
+    futexlock(&futexword);
+    tmp = gcnt;
+    tmp++;
+    nop();
+    gcnt = tmp;
+    futexunlock(&futexword);
+  }
+  thread_exit((void *)(tid+1));
+}
+
+int
+futextest(void)
+{
+  thread_t threads[NUM_THREAD];
+  int i;
+  void *retval;
+
+  gcnt = 0;
+  futexword = 1;
+  if (futex_wait(&futexword, 0) != -1 || futex_wake(&futexword, 1) != 0){
+    printf(1, "panic at futex_wait on a changed word\n");
+    return -1;
+  }
+  if (futex_wait((int*)((char*)&futexword + 1), 1) != -1){
+    printf(1, "panic at futex_wait on an unaligned word\n");
+    return -1;
+  }
+  futexword = 0;
+  for (i = 0; i < NUM_THREAD; i++){
+    if (thread_create(&threads[i], futexthreadmain, (void*)i) != 0){
+      printf(1, "panic at thread_create\n");
+      return -1;
+    }
+  }
+  for (i = 0; i < NUM_THREAD; i++){
+    if (thread_join(threads[i], &retval) != 0 || (int)retval != i+1){
+      printf(1, "panic at thread_join\n");
+      return -1;
+    }
+  }
+  printf(1, "%d, %d waits\n", gcnt, nfutexwait);
+  if (gcnt != NUM_THREAD * 1000000){
+    printf(1, "panic at futex lock\n");
+    return -1;
+  }
+  return 0;
+}
+
+// ============================================================================
+struct barrier gbarrier;
+struct rwlock grwlock;
+struct semaphore gsem;
+int gphase[NUM_THREAD];
+int gpair[2];
+
+void*
+syncthreadmain(void *arg)
+{
+  int tid = (int) arg;
+  int i, r;
+  int bad = 0;
+
+  for (r = 0; r < 100; r++){
+    gphase[tid] = r;
+    barrier_wait(&gbarrier);
+    for (i = 0; i < NUM_THREAD; i++)
+      if (gphase[i] != r)
+        bad++;
+    barrier_wait(&gbarrier);
+  }
+  for (i = 0; i < 1000; i++){
+    if (i % NUM_THREAD == tid){
+      rwlock_wrlock(&grwlock);
+      gpair[0]++;
+      nop();
+      gpair[1]++;
+      rwlock_unlock(&grwlock);
+    } else {
+      rwlock_rdlock(&grwlock);
+      if (gpair[0] != gpair[1])
+        bad++;
+      rwlock_unlock(&grwlock);
+    }
+  }
+  sem_post(&gsem);
+  thread_exit((void *)bad);
+}
+
+int
+synctest(void)
+{
+  thread_t threads[NUM_THREAD];
+  int i;
+  void *retval;
+
+  barrier_init(&gbarrier, NUM_THREAD);
+  rwlock_init(&grwlock);
+  sem_init(&gsem, 0);
+  if (sem_trywait(&gsem) == 0){
+    printf(1, "panic at sem_trywait\n");
+    return -1;
+  }
+  for (i = 0; i < NUM_THREAD; i++){
+    if (thread_create(&threads[i], syncthreadmain, (void*)i) != 0){
+      printf(1, "panic at thread_create\n");
+      return -1;
+    }
+  }
+  for (i = 0; i < NUM_THREAD; i++)
+    sem_wait(&gsem);
+  for (i = 0; i < NUM_THREAD; i++){
+    if (thread_join(threads[i], &retval) != 0 || retval != 0){
+      printf(1, "panic at thread_join\n");
+      return -1;
+    }
+  }
+  if (gpair[0] != 1000 || gpair[1] != 1000){
+    printf(1, "panic at rwlock\n");
+    return -1;
+  }
+  return 0;
+}
+
+// ============================================================================
+void*
+detachthreadmain(void *arg)
+{
+  int tid = (int) arg;
+  if (tid >= NUM_THREAD)
+    sem_post(&gsem);
+  thread_exit((void *)(tid+1));
+}
+
+int
+detachtest(void)
+{
+  thread_t threads[NUM_THREAD];
+  thread_t t;
+  int i, j, seen = 0;
+  void *retval;
+
+  if (thread_join_any(&t, &retval) != -1){
+    printf(1, "panic at thread_join_any without threads\n");
+    return -1;
+  }
+  for (i = 0; i < NUM_THREAD; i++){
+    if (thread_create(&threads[i], detachthreadmain, (void*)i) != 0){
+      printf(1, "panic at thread_create\n");
+      return -1;
+    }
+  }
+  for (i = 0; i < NUM_THREAD; i++){
+    if (thread_join_any(&t, &retval) != 0){
+      printf(1, "panic at thread_join_any\n");
+      return -1;
+    }
+    for (j = 0; j < NUM_THREAD && threads[j] != t; j++)
+      ;
+    if (j == NUM_THREAD || (int)retval != j+1 || (seen & (1 << j))){
+      printf(1, "panic at thread_join_any: thread %d, retval %d\n",
+             t, (int)retval);
+      return -1;
+    }
+    seen |= 1 << j;
+  }
+
+  // Detached threads must give their slots back, or this runs out.
+  sem_init(&gsem, 0);
+  for (i = 0; i < 3 * 64; i++){
+    if (thread_create(&t, detachthreadmain, (void*)NUM_THREAD) != 0 ||
+        thread_detach(t) != 0){
+      printf(1, "panic at thread_detach\n");
+      return -1;
+    }
+    if (thread_join(t, &retval) != -1){
+      printf(1, "panic at thread_join of a detached thread\n");
+      return -1;
+    }
+    sem_wait(&gsem);
+  }
+
+  // Detaching a thread that has exited reaps it.
+  if (thread_create(&t, detachthreadmain, (void*)0) != 0){
+    printf(1, "panic at thread_create\n");
+    return -1;
+  }
+  sleep(10);
+  if (thread_detach(t) != 0 || thread_join(t, &retval) != -1){
+    printf(1, "panic at thread_detach of an exited thread\n");
+    return -1;
+  }
+  return 0;
+}
+
+// ============================================================================
+#define JOINROUNDS 200
+
+void*
+emptythreadmain(void *arg)
+{
+  thread_exit(arg);
+}
+
+int
+joinbench(void)
+{
+  thread_t threads[NUM_THREAD];
+  thread_t t;
+  int i, r, how, ret;
+  uint start, ticks;
+  void *retval;
+  char *name[] = { "join", "join_any", "detach" };
+
+  for (how = 0; how < 3; how++){
+    sem_init(&gsem, 0);
+    start = uptime();
+    for (r = 0; r < JOINROUNDS; r++){
+      for (i = 0; i < NUM_THREAD; i++){
+        if (thread_create(&threads[i], how == 2 ? detachthreadmain
+                          : emptythreadmain, (void*)NUM_THREAD) != 0){
+          printf(1, "panic at thread_create\n");
+          return -1;
+        }
+        if (how == 2)
+          thread_detach(threads[i]);
+      }
+      for (i = 0; i < NUM_THREAD; i++){
+        ret = 0;
+        if (how == 0)
+          ret = thread_join(threads[i], &retval);
+        else if (how == 1)
+          ret = thread_join_any(&t, &retval);
+        else
+          sem_wait(&gsem);
+        if (ret != 0){
+          printf(1, "panic at %s\n", name[how]);
+          return -1;
+        }
+      }
+    }
+    ticks = uptime() - start;
+    printf(1, "%s: %d threads in %d ticks, %d per tick\n", name[how],
+           JOINROUNDS * NUM_THREAD, ticks,
+           JOINROUNDS * NUM_THREAD / (ticks ? ticks : 1));
+  }
+  return 0;
+}
+
+// ============================================================================
+void*
+orphanthreadmain(void *arg)
+{
+  thread_t t;
+  void *retval;
+  int ret = 0;
+  char *p;
+
+  sleep(10);
+  // The main thread has exited; its address space is still ours.
+  if (gcnt != 1){
+    printf(1, "panic at shared memory\n");
+    ret = -1;
+  }
+  if ((p = sbrk(4096)) == (char*)-1){
+    printf(1, "panic at sbrk\n");
+    ret = -1;
+  } else
+    p[4095] = 1;
+  if (thread_create(&t, emptythreadmain, (void*)7) != 0 ||
+      thread_join(t, &retval) != 0 || (int)retval != 7){
+    printf(1, "panic at thread_create after main exit\n");
+    ret = -1;
+  }
+  write(gpipe[1], (char*)&ret, sizeof(ret));
+  close(gpipe[1]);
+  // The last thread to exit ends the process.
+  thread_exit(0);
+}
+
+int
+mainexittest(void)
+{
+  thread_t t;
+
+  gcnt = 1;
+  if (thread_create(&t, orphanthreadmain, 0) != 0){
+    printf(1, "panic at thread_create\n");
+    return -1;
+  }
+  thread_exit(0);
+}
@@ -0,0 +1,139 @@
+// Hierarchical timing wheel.
+//
+// Timers are kept in NLVL levels of NSLOT slots each. Level 0 has
+// one slot per tick; a slot at level n covers NSLOT^n ticks.
+// Whenever the level 0 index wraps, the next slot of level 1 is
+// cascaded into level 0, and so on up the levels. The timer
+// interrupt therefore only touches timers that are about to
+// expire, and adding or deleting a timer is O(1).
+//
+// The wheel is protected by tickslock, and the timer functions
+// run with it held.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "timer.h"
+
+#define SLOTBITS 6
+#define NSLOT (1 << SLOTBITS)
+#define SLOTMASK (NSLOT - 1)
+#define NLVL 4
+
+// The largest delay the wheel can hold.
+#define MAXDELAY ((1 << (SLOTBITS * NLVL)) - 1)
+
+static struct {
+  struct timer *slot[NLVL][NSLOT];
+  uint clk;                     // next tick to be processed
+} wheel;
+
+static void
+slotadd(struct timer **slot, struct timer *t)
+{
+  t->next = *slot;
+  if (*slot)
+    (*slot)->pprev = &t->next;
+  *slot = t;
+  t->pprev = slot;
+}
+
+// Put t in the slot matching its expiry relative to wheel.clk.
+// A timer further out than MAXDELAY goes in the slot for
+// MAXDELAY; t->expires is left alone, so when that slot cascades
+// the timer is put back on the wheel for the time still left.
+static void
+wheeladd(struct timer *t)
+{
+  uint delta = t->expires - wheel.clk;
+  uint expires = t->expires;
+  int lvl;
+
+  if ((int)delta < 0) {
+    // Already due: run on the next processed tick.
+    slotadd(&wheel.slot[0][wheel.clk & SLOTMASK], t);
+    return;
+  }
+  if (delta > MAXDELAY) {
+    delta = MAXDELAY;
+    expires = wheel.clk + MAXDELAY;
+  }
+  for (lvl = 0; lvl < NLVL - 1; lvl++)
+    if (delta < (1 << (SLOTBITS * (lvl + 1))))
+      break;
+  slotadd(&wheel.slot[lvl][(expires >> (SLOTBITS * lvl)) & SLOTMASK], t);
+}
+
+// Arm t to call fn(arg) once ticks reaches expires.
+// Caller holds tickslock; t must not be pending.
+void
+timeradd(struct timer *t, uint expires, void (*fn)(void*), void *arg)
+{
+  if (!holding(&tickslock))
+    panic("timeradd");
+  if (t->pending)
+    panic("timeradd pending");
+  t->expires = expires;
+  t->fn = fn;
+  t->arg = arg;
+  t->pending = 1;
+  wheeladd(t);
+}
+
+// Disarm t. Returns 1 if it was still pending.
+// Caller holds tickslock.
+int
+timerdel(struct timer *t)
+{
+  if (!holding(&tickslock))
+    panic("timerdel");
+  if (!t->pending)
+    return 0;
+  *t->pprev = t->next;
+  if (t->next)
+    t->next->pprev = t->pprev;
+  t->pending = 0;
+  return 1;
+}
+
+// Move the timers of slot idx at level lvl down the wheel.
+// Returns idx, so a cascade of the next level happens when it is 0.
+static int
+cascade(int lvl, int idx)
+{
+  struct timer *t, *next;
+
+  t = wheel.slot[lvl][idx];
+  wheel.slot[lvl][idx] = 0;
+  for (; t; t = next) {
+    next = t->next;
+    wheeladd(t);
+  }
+  return idx;
+}
+
+// Run every timer that expired up to the current ticks.
+// Called by the timer interrupt with tickslock held.
+void
+timertick(void)
+{
+  struct timer *t, *next;
+  int idx, lvl;
+
+  while ((int)(ticks - wheel.clk) >= 0) {
+    idx = wheel.clk & SLOTMASK;
+    for (lvl = 1; idx == 0 && lvl < NLVL; lvl++)
+      idx = cascade(lvl, (wheel.clk >> (SLOTBITS * lvl)) & SLOTMASK);
+
+    idx = wheel.clk & SLOTMASK;
+    t = wheel.slot[0][idx];
+    wheel.slot[0][idx] = 0;
+    wheel.clk++;
+    for (; t; t = next) {
+      next = t->next;
+      t->pending = 0;
+      t->fn(t->arg);
+    }
+  }
+}
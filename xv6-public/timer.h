@@ -0,0 +1,9 @@
+// Kernel timer, see timer.c.
+struct timer {
+  struct timer *next;   // next timer in the same wheel slot
+  struct timer **pprev; // link pointing at this timer
+  uint expires;         // value of ticks at which fn runs
+  void (*fn)(void*);    // called with tickslock held
+  void *arg;            // argument for fn
+  int pending;          // on the wheel, fn not called yet
+};
@@ -0,0 +1,114 @@
+// Scheduler event trace.
+//
+// Each cpu logs events into its own ring, so recording one takes
+// no lock: with interrupts off nothing else writes to the ring,
+// and the entry is filled in before head moves past it. When the
+// ring is full the oldest entries are overwritten.
+//
+// Readers drain a ring with schedtrace(). They hold the ring's
+// lock only against each other. Entries the writer overwrote
+// before or while a reader copied them are reported as a single
+// SEV_LOST event instead.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "schedtrace.h"
+
+static struct tracering {
+  struct spinlock lock;         // serializes readers
+  struct schedev ev[NTRACE];
+  volatile uint head;           // entries ever written
+  uint tail;                    // entries ever read or lost
+} ring[NCPU];
+
+void
+traceinit(void)
+{
+  int i;
+
+  for (i = 0; i < NCPU; i++)
+    initlock(&ring[i].lock, "trace");
+}
+
+// Log an event about p (or none if p is 0) on this cpu.
+void
+trace(int type, struct proc *p, int arg)
+{
+  struct tracering *r;
+  struct schedev *e;
+  int id;
+
+  pushcli();
+  id = cpuid();
+  r = &ring[id];
+  e = &r->ev[r->head & (NTRACE-1)];
+  e->tsc = rdtsc();
+  e->pid = p ? p->pid : 0;
+  e->type = type;
+  e->cpu = id;
+  e->arg = arg;
+  __sync_synchronize();
+  r->head++;
+  popcli();
+}
+
+// Fill in e as a SEV_LOST event for n events of cpu.
+static void
+tracelost(struct schedev *e, int cpu, uint n)
+{
+  e->tsc = rdtsc();
+  e->pid = 0;
+  e->type = SEV_LOST;
+  e->cpu = cpu;
+  e->arg = n;
+}
+
+// Copy up to n of the oldest unread events of cpu's ring to buf.
+// Returns the number of events copied, or -1 if there is no
+// such cpu.
+int
+schedtrace(int cpu, struct schedev *buf, int n)
+{
+  struct tracering *r;
+  uint head, start, k, lost;
+
+  if (cpu < 0 || cpu >= ncpu || n <= 0)
+    return -1;
+  r = &ring[cpu];
+  acquire(&r->lock);
+  head = r->head;
+  __sync_synchronize();
+  if (head - r->tail > NTRACE) {
+    tracelost(&buf[0], cpu, head - r->tail - NTRACE);
+    r->tail = head - NTRACE;
+    release(&r->lock);
+    return 1;
+  }
+
+  start = r->tail;
+  for (k = 0; k < n && start + k != head; k++)
+    buf[k] = r->ev[(start + k) & (NTRACE-1)];
+  r->tail = start + k;
+
+  // The first lost entries may have been overwritten during the
+  // copy; replace them with one SEV_LOST event.
+  __sync_synchronize();
+  lost = r->head - start;
+  release(&r->lock);
+  if (lost <= NTRACE)
+    return k;
+  lost -= NTRACE;
+  if (lost > k)
+    lost = k;
+  if (lost == 0)
+    return k;
+  memmove(&buf[1], &buf[lost], (k - lost) * sizeof(buf[0]));
+  tracelost(&buf[0], cpu, lost);
+  return k - lost + 1;
+}
@@ -43,16 +43,26 @@ trap(struct trapframe *tf)
     syscall();
     if(myproc()->killed)
       exit();
+    // The call may have woken a process that must run before
+    // this one here, as an edf wakeup does.
+    if(needresched()){
+      yield();
+      if(myproc()->killed)
+        exit();
+    }
     return;
   }
 
+  // Wakeups from here are not made by the process we interrupted.
+  mycpu()->intr = 1;
   switch(tf->trapno){
   case T_IRQ0 + IRQ_TIMER:
     if(cpuid() == 0){
       acquire(&tickslock);
       ticks++;
-      wakeup(&ticks);
+      timertick();
       release(&tickslock);
+      schedclock();
     }
     lapiceoi();
     break;
@@ -60,6 +70,11 @@ trap(struct trapframe *tf)
     ideintr();
     lapiceoi();
     break;
+  case T_IRQ0 + IRQ_RESCHED:
+    // Work was queued for this cpu, or its process is to be
+    // preempted; leave hlt and check resched below.
+    lapiceoi();
+    break;
   case T_IRQ0 + IRQ_IDE+1:
     // Bochs generates spurious IDE1 interrupts.
     break;
@@ -93,6 +108,7 @@ trap(struct trapframe *tf)
             tf->err, cpuid(), tf->eip, rcr2());
     myproc()->killed = 1;
   }
+  mycpu()->intr = 0;
 
   // Force process exit if it has been killed and is in user space.
   // (If it is still executing in the kernel, let it keep running
@@ -104,13 +120,13 @@ trap(struct trapframe *tf)
   // If interrupts were on while locks held, would need to check nlock.
   if(myproc() && myproc()->state == RUNNING &&
      tf->trapno == T_IRQ0+IRQ_TIMER) {
-    if (myproc()->type == 'm') { 
-      mlfq_yield();
-    } else {
-      stride_yield();
-    }
+    schedtick();
   }
 
+  // Give up the CPU to a process that must run before this one.
+  if(myproc() && myproc()->state == RUNNING && needresched())
+    yield();
+
   // Check if the process has been killed since we yielded
   if(myproc() && myproc()->killed && (tf->cs&3) == DPL_USER)
     exit();
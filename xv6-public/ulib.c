@@ -3,6 +3,7 @@
 #include "fcntl.h"
 #include "user.h"
 #include "x86.h"
+#include "cpustat.h"
 
 char*
 strcpy(char *s, char *t)
@@ -103,3 +104,35 @@ memmove(void *vdst, void *vsrc, int n)
     *dst++ = *src++;
   return vdst;
 }
+
+// Number of cpus: getcpustat() fails past the last one.
+int
+ncpus(void)
+{
+  struct cpustat st;
+  int n;
+
+  for(n = 0; getcpustat(n, &st) == 0; n++)
+    ;
+  return n;
+}
+
+// Add up the statistics of every cpu in *sum.
+void
+sumcpustat(struct cpustat *sum)
+{
+  struct cpustat st;
+  int i;
+
+  memset(sum, 0, sizeof(*sum));
+  for(i = 0; getcpustat(i, &st) == 0; i++){
+    sum->nsteal += st.nsteal;
+    sum->nmigrate += st.nmigrate;
+    sum->nqueued += st.nqueued;
+    sum->nidle += st.nidle;
+    sum->idleticks += st.idleticks;
+    sum->nhandoff += st.nhandoff;
+    sum->ngang += st.ngang;
+    sum->ninherit += st.ninherit;
+  }
+}
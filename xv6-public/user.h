@@ -1,5 +1,13 @@
 struct stat;
 struct rtcdate;
+struct cpustat;
+struct mlfqparam;
+struct schedev;
+struct mutex;
+struct cond;
+struct rwlock;
+struct barrier;
+struct semaphore;
 
 // system calls
 int fork(void);
@@ -32,10 +40,25 @@ int set_cpu_share(int tickets);
 int thread_create(thread_t *thread, void *(*start_routine)(void *), void *arg);
 int thread_join(thread_t thread, void **retval);
 int thread_exit(void *retval) __attribute__((noreturn));
+int thread_join_any(thread_t *thread, void **retval);
+int thread_detach(thread_t thread);
 void printallstate(void);
 /* Proj5 */
 int pwrite(int, void*, int, int);
 int pread (int, void*, int, int);
+/* Scheduler */
+int getcpustat(int, struct cpustat*);
+int set_deadline(int runtime, int period);
+int getmlfqparam(struct mlfqparam*);
+int setmlfqparam(struct mlfqparam*);
+int yield_to(thread_t thread);
+int set_gang(int on);
+int sched_setaffinity(int pid, uint mask);
+int sched_getaffinity(int pid, uint *mask);
+int schedtrace(int, struct schedev*, int);
+int set_mlfq_floor(int percent);
+int futex_wait(int *addr, int val);
+int futex_wake(int *addr, int n);
 
 // ulib.c
 int stat(char*, struct stat*);
@@ -50,3 +73,25 @@ void* memset(void*, int, uint);
 void* malloc(uint);
 void free(void*);
 int atoi(const char*);
+int ncpus(void);
+void sumcpustat(struct cpustat*);
+
+// usync.c
+void mutex_init(struct mutex*);
+void mutex_lock(struct mutex*);
+int mutex_trylock(struct mutex*);
+void mutex_unlock(struct mutex*);
+void cond_init(struct cond*);
+void cond_wait(struct cond*, struct mutex*);
+void cond_signal(struct cond*);
+void cond_broadcast(struct cond*);
+void rwlock_init(struct rwlock*);
+void rwlock_rdlock(struct rwlock*);
+void rwlock_wrlock(struct rwlock*);
+void rwlock_unlock(struct rwlock*);
+void barrier_init(struct barrier*, int n);
+int barrier_wait(struct barrier*);
+void sem_init(struct semaphore*, int val);
+int sem_trywait(struct semaphore*);
+void sem_wait(struct semaphore*);
+void sem_post(struct semaphore*);
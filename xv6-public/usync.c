@@ -0,0 +1,208 @@
+// Mutexes, condition variables, reader-writer locks, barriers and
+// semaphores for threads, built on futex_wait() and futex_wake().
+//
+// Nothing here enters the kernel unless a thread has to wait or
+// there is a waiter to wake. A contended mutex_lock() spins for a
+// short while first, since the holder is likely to be running on
+// another cpu and about to let go; after that it sleeps in the
+// kernel instead of burning its time slice.
+
+#include "types.h"
+#include "user.h"
+#include "usync.h"
+
+#define SPIN    100     // (iteration) mutex_lock() spins before sleeping
+
+static inline void
+cpu_relax(void)
+{
+  asm volatile("pause");
+}
+
+void
+mutex_init(struct mutex *m)
+{
+  m->val = 0;
+}
+
+int
+mutex_trylock(struct mutex *m)
+{
+  return __sync_val_compare_and_swap(&m->val, 0, 1) == 0 ? 0 : -1;
+}
+
+void
+mutex_lock(struct mutex *m)
+{
+  int c, i;
+
+  for (i = 0; i < SPIN; i++) {
+    if ((c = __sync_val_compare_and_swap(&m->val, 0, 1)) == 0)
+      return;
+    if (c == 2)
+      break;
+    cpu_relax();
+  }
+  // Mark the lock contended; whoever holds it will wake us.
+  while (__sync_lock_test_and_set(&m->val, 2) != 0)
+    futex_wait(&m->val, 2);
+}
+
+void
+mutex_unlock(struct mutex *m)
+{
+  if (__sync_fetch_and_sub(&m->val, 1) != 1) {
+    m->val = 0;
+    futex_wake(&m->val, 1);
+  }
+}
+
+void
+cond_init(struct cond *c)
+{
+  c->seq = 0;
+  c->nwait = 0;
+}
+
+// Atomically release m and wait for a signal, then take m again.
+// Like any condition variable, it may return without one.
+void
+cond_wait(struct cond *c, struct mutex *m)
+{
+  int seq = c->seq;
+
+  __sync_fetch_and_add(&c->nwait, 1);
+  mutex_unlock(m);
+  futex_wait(&c->seq, seq);
+  __sync_fetch_and_sub(&c->nwait, 1);
+  // Others may have been woken with us; take m as contended so
+  // that our unlock wakes the next of them.
+  while (__sync_lock_test_and_set(&m->val, 2) != 0)
+    futex_wait(&m->val, 2);
+}
+
+void
+cond_signal(struct cond *c)
+{
+  __sync_fetch_and_add(&c->seq, 1);
+  if (c->nwait)
+    futex_wake(&c->seq, 1);
+}
+
+void
+cond_broadcast(struct cond *c)
+{
+  __sync_fetch_and_add(&c->seq, 1);
+  if (c->nwait)
+    futex_wake(&c->seq, c->nwait);
+}
+
+void
+rwlock_init(struct rwlock *rw)
+{
+  memset(rw, 0, sizeof(*rw));
+}
+
+void
+rwlock_rdlock(struct rwlock *rw)
+{
+  mutex_lock(&rw->m);
+  while (rw->writer || rw->nwwait)
+    cond_wait(&rw->rd, &rw->m);
+  rw->nreader++;
+  mutex_unlock(&rw->m);
+}
+
+void
+rwlock_wrlock(struct rwlock *rw)
+{
+  mutex_lock(&rw->m);
+  rw->nwwait++;
+  while (rw->writer || rw->nreader)
+    cond_wait(&rw->wr, &rw->m);
+  rw->nwwait--;
+  rw->writer = 1;
+  mutex_unlock(&rw->m);
+}
+
+void
+rwlock_unlock(struct rwlock *rw)
+{
+  mutex_lock(&rw->m);
+  if (rw->writer)
+    rw->writer = 0;
+  else
+    rw->nreader--;
+  if (rw->nreader == 0) {
+    if (rw->nwwait)
+      cond_signal(&rw->wr);
+    else
+      cond_broadcast(&rw->rd);
+  }
+  mutex_unlock(&rw->m);
+}
+
+void
+barrier_init(struct barrier *b, int n)
+{
+  memset(b, 0, sizeof(*b));
+  b->n = n;
+}
+
+// Wait until n threads have called barrier_wait(). Returns 1 in
+// the last thread to arrive and 0 in the others.
+int
+barrier_wait(struct barrier *b)
+{
+  int round;
+
+  mutex_lock(&b->m);
+  round = b->round;
+  if (++b->count == b->n) {
+    b->count = 0;
+    b->round++;
+    cond_broadcast(&b->c);
+    mutex_unlock(&b->m);
+    return 1;
+  }
+  while (round == b->round)
+    cond_wait(&b->c, &b->m);
+  mutex_unlock(&b->m);
+  return 0;
+}
+
+void
+sem_init(struct semaphore *s, int val)
+{
+  s->val = val;
+  s->nwait = 0;
+}
+
+int
+sem_trywait(struct semaphore *s)
+{
+  int v;
+
+  while ((v = s->val) > 0)
+    if (__sync_val_compare_and_swap(&s->val, v, v - 1) == v)
+      return 0;
+  return -1;
+}
+
+void
+sem_wait(struct semaphore *s)
+{
+  while (sem_trywait(s) < 0) {
+    __sync_fetch_and_add(&s->nwait, 1);
+    futex_wait(&s->val, 0);
+    __sync_fetch_and_sub(&s->nwait, 1);
+  }
+}
+
+void
+sem_post(struct semaphore *s)
+{
+  __sync_fetch_and_add(&s->val, 1);
+  if (s->nwait)
+    futex_wake(&s->val, 1);
+}
@@ -0,0 +1,34 @@
+// Thread synchronization for user programs, see usync.c.
+// Zero-filled objects are ready to use, except that a barrier
+// needs barrier_init() and a semaphore its count.
+
+struct mutex {
+  int val;        // 0 unlocked, 1 locked, 2 locked with waiters
+};
+
+struct cond {
+  int seq;        // bumped by every signal, futex word of waiters
+  int nwait;      // threads in cond_wait()
+};
+
+struct rwlock {
+  struct mutex m;
+  struct cond rd; // readers wait for the writer to leave
+  struct cond wr; // writers wait for everyone to leave
+  int nreader;    // readers inside
+  int writer;     // a writer is inside
+  int nwwait;     // writers waiting, they go before new readers
+};
+
+struct barrier {
+  struct mutex m;
+  struct cond c;
+  int n;          // threads to wait for
+  int count;      // threads arrived this round
+  int round;
+};
+
+struct semaphore {
+  int val;        // count, never negative
+  int nwait;      // threads in sem_wait()
+};
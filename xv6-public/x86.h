@@ -91,6 +91,16 @@ ltr(ushort sel)
   asm volatile("ltr %0" : : "r" (sel));
 }
 
+// Low 32 bits of the time stamp counter.
+static inline uint
+rdtsc(void)
+{
+  uint lo, hi;
+
+  asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
+  return lo;
+}
+
 static inline uint
 readeflags(void)
 {
@@ -117,6 +127,20 @@ sti(void)
   asm volatile("sti");
 }
 
+// Enable interrupts and halt until one arrives. sti takes effect
+// only after the next instruction, so none can slip in before hlt.
+static inline void
+stihlt(void)
+{
+  asm volatile("sti; hlt");
+}
+
+static inline void
+pause(void)
+{
+  asm volatile("pause" : : : "memory");
+}
+
 static inline uint
 xchg(volatile uint *addr, uint newval)
 {
@@ -130,6 +154,16 @@ xchg(volatile uint *addr, uint newval)
   return result;
 }
 
+// Index of the least significant set bit; val must be non-zero.
+static inline uint
+bsf(uint val)
+{
+  uint idx;
+
+  asm volatile("bsfl %1,%0" : "=r" (idx) : "rm" (val) : "cc");
+  return idx;
+}
+
 static inline uint
 rcr2(void)
 {